@@ -188,6 +188,30 @@ struct udev_list_entry *udev_hwdb_get_properties_list_entry(
 
 int udev_util_encode_string(const char *str, char *str_enc, size_t len);
 
+/* libudev-bsd extensions */
+enum udev_stat {
+	UDEV_STAT_FILTER_PROBES,	/* devices built to evaluate filters */
+	UDEV_STAT_FILTER_PROBES_AVOIDED, /* rejected before device was built */
+	UDEV_STAT_SCAN_CACHE_HITS,	/* scans answered from cache */
+	UDEV_STAT_SCAN_CACHE_MISSES,
+	UDEV_STAT_DEVICE_CACHE_HITS,	/* devices shared from cache */
+	UDEV_STAT_DEVICE_CACHE_MISSES,
+	UDEV_STAT_DEVICE_PROBES,	/* create handlers run */
+	UDEV_STAT_CNT,
+};
+unsigned long udev_get_stat(struct udev *udev, enum udev_stat stat);
+int udev_enumerate_set_parallel(struct udev_enumerate *udev_enumerate,
+    int nthreads);
+typedef int (*udev_enumerate_cb_t)(struct udev_enumerate *udev_enumerate,
+    const char *syspath, void *arg);
+int udev_enumerate_scan_devices_cb(struct udev_enumerate *udev_enumerate,
+    udev_enumerate_cb_t cb, void *arg);
+int udev_enumerate_rescan_devices(struct udev_enumerate *udev_enumerate);
+struct udev_list_entry *udev_enumerate_get_added_list_entry(
+    struct udev_enumerate *udev_enumerate);
+struct udev_list_entry *udev_enumerate_get_removed_list_entry(
+    struct udev_enumerate *udev_enumerate);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
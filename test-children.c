@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Checks subsystem directed /dev walk, streaming scan stop and parent
+ * lookup through the children index against a fixture tree of DRM nodes.
+ */
+
+#include <sys/types.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libudev.h"
+#include "test-fixture.h"
+
+static const struct {
+	const char *syspath;
+	const char *target;
+} fixtures[] = {
+	{ "/dev/dri/card0", FIXTURE_NODE_A },
+	{ "/dev/dri/card1", FIXTURE_NODE_B },
+	{ "/dev/dri/card2", FIXTURE_NODE_A },
+	{ "/dev/dri/card3", FIXTURE_NODE_A },
+	{ "/dev/dri/card4", FIXTURE_NODE_A },
+	{ "/dev/dri/card5", FIXTURE_NODE_A },
+	/* Not matched by drm glob */
+	{ "/dev/dri/renderD128", FIXTURE_NODE_C },
+};
+
+static int failed;
+
+#define	CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed++;						\
+	}								\
+} while (0)
+
+static int
+fixtures_create(void)
+{
+	size_t i;
+
+	if (fixture_init() == -1)
+		return (-1);
+	for (i = 0; i < sizeof(fixtures) / sizeof(fixtures[0]); i++)
+		if (fixture_link(fixtures[i].syspath, fixtures[i].target) == -1)
+			return (-1);
+
+	return (0);
+}
+
+/* Returns true if @p syspath is in the scan result of @p ue */
+static bool
+scanned(struct udev_enumerate *ue, const char *syspath)
+{
+	struct udev_list_entry *ule;
+
+	udev_list_entry_foreach(ule, udev_enumerate_get_list_entry(ue))
+		if (strcmp(udev_list_entry_get_name(ule), syspath) == 0)
+			return (true);
+
+	return (false);
+}
+
+static void
+test_subsystem_walk(struct udev *udev)
+{
+	struct udev_enumerate *ue;
+
+	ue = udev_enumerate_new(udev);
+	CHECK(udev_enumerate_add_match_subsystem(ue, "drm") == 0);
+	CHECK(udev_enumerate_scan_devices(ue) == 0);
+	CHECK(scanned(ue, "/dev/dri/card0"));
+	CHECK(scanned(ue, "/dev/dri/card1"));
+	CHECK(!scanned(ue, "/dev/dri/renderD128"));
+	udev_enumerate_unref(ue);
+
+	ue = udev_enumerate_new(udev);
+	CHECK(udev_enumerate_add_match_subsystem(ue, "input") == 0);
+	CHECK(udev_enumerate_scan_devices(ue) == 0);
+	CHECK(!scanned(ue, "/dev/dri/card0"));
+	udev_enumerate_unref(ue);
+}
+
+static int
+stream_stop_cb(struct udev_enumerate *ue, const char *syspath, void *arg)
+{
+	int *calls = arg;
+
+	(*calls)++;
+	return (1);
+}
+
+/* Callback asking to stop is not called again by any worker */
+static void
+test_stream_stop(struct udev *udev)
+{
+	struct udev_enumerate *ue;
+	int calls, nthreads;
+
+	for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+		ue = udev_enumerate_new(udev);
+		CHECK(udev_enumerate_add_match_subsystem(ue, "drm") == 0);
+		CHECK(udev_enumerate_set_parallel(ue, nthreads) == 0);
+		calls = 0;
+		CHECK(udev_enumerate_scan_devices_cb(ue, stream_stop_cb,
+		    &calls) == 0);
+		CHECK(calls == 1);
+		/* Stop request does not outlive the scan */
+		calls = 0;
+		CHECK(udev_enumerate_scan_devices_cb(ue, stream_stop_cb,
+		    &calls) == 0);
+		CHECK(calls == 1);
+		udev_enumerate_unref(ue);
+	}
+}
+
+/* Scans children of @p parent twice, the second time from the index */
+static void
+test_children(struct udev *udev, struct udev_device *parent,
+    const char *child, const char *other)
+{
+	struct udev_enumerate *ue;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		ue = udev_enumerate_new(udev);
+		CHECK(udev_enumerate_add_match_parent(ue, parent) == 0);
+		CHECK(udev_enumerate_scan_devices(ue) == 0);
+		CHECK(scanned(ue, child));
+		CHECK(!scanned(ue, other));
+		udev_enumerate_unref(ue);
+	}
+}
+
+static void
+test_parent_links(struct udev *udev)
+{
+	struct udev_device *ud, *parent;
+
+	ud = udev_device_new_from_syspath(udev, "/dev/dri/card0");
+	CHECK(ud != NULL);
+	if (ud == NULL)
+		return;
+	parent = udev_device_get_parent(ud);
+	CHECK(parent != NULL);
+	if (parent != NULL) {
+		test_children(udev, parent, "/dev/dri/card0",
+		    "/dev/dri/card1");
+		/* Index is rebuilt once /dev changes */
+		CHECK(fixture_unlink("/dev/dri/card1") == 0);
+		test_children(udev, parent, "/dev/dri/card0",
+		    "/dev/dri/card1");
+	}
+	udev_device_unref(ud);
+}
+
+int
+main(void)
+{
+	struct udev *udev;
+
+	if (fixtures_create() == -1) {
+		perror("fixture");
+		return (EXIT_FAILURE);
+	}
+
+	udev = udev_new();
+	if (udev == NULL)
+		return (EXIT_FAILURE);
+	test_subsystem_walk(udev);
+	test_stream_stop(udev);
+	test_parent_links(udev);
+	udev_unref(udev);
+
+	return (failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Checks device number and device id to syspath resolution and the
+ * devnum index against a fixture tree of DRM nodes which are replaced
+ * and removed under it.
+ */
+
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "udev-global.h"
+#include "test-fixture.h"
+
+#define	CARD_A		"/dev/dri/card0"
+#define	CARD_B		"/dev/dri/card1"
+
+static dev_t devnum_a, devnum_b, devnum_c;
+
+static int failed;
+
+#define	CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed++;						\
+	}								\
+} while (0)
+
+static int
+fixtures_create(void)
+{
+
+	if (fixture_init() == -1 ||
+	    fixture_link(CARD_A, FIXTURE_NODE_A) == -1 ||
+	    fixture_link(CARD_B, FIXTURE_NODE_B) == -1)
+		return (-1);
+
+	devnum_a = fixture_devnum(FIXTURE_NODE_A);
+	devnum_b = fixture_devnum(FIXTURE_NODE_B);
+	devnum_c = fixture_devnum(FIXTURE_NODE_C);
+	return (0);
+}
+
+/* Checks that @p devnum resolves to @p expected, NULL if none */
+static void
+check_lookup(dev_t devnum, const char *expected)
+{
+	const char *syspath;
+
+	syspath = get_syspath_by_devnum(devnum);
+	if (expected == NULL)
+		CHECK(syspath == NULL);
+	else
+		CHECK(syspath != NULL && strcmp(syspath, expected) == 0);
+	free((void *)syspath);
+}
+
+static void
+test_enumerated(struct udev *udev)
+{
+	struct udev_enumerate *ue;
+	struct udev_device *ud;
+
+	/* Enumeration indexes the nodes it passes */
+	ue = udev_enumerate_new(udev);
+	CHECK(udev_enumerate_add_match_subsystem(ue, "drm") == 0);
+	CHECK(udev_enumerate_scan_devices(ue) == 0);
+	udev_enumerate_unref(ue);
+	check_lookup(devnum_a, CARD_A);
+	check_lookup(devnum_b, CARD_B);
+
+	ud = udev_device_new_from_devnum(udev, 'c', devnum_b);
+	CHECK(ud != NULL);
+	if (ud != NULL) {
+		CHECK(strcmp(udev_device_get_syspath(ud), CARD_B) == 0);
+		CHECK(udev_device_get_devnum(ud) == devnum_b);
+		udev_device_unref(ud);
+	}
+}
+
+static void
+test_device_id(struct udev *udev)
+{
+	static const char *const malformed[] = {
+		"c %u:%u", "c+%u:%u", "c%u: %u", "c%u:-%u", "c%u:%ux",
+		"c%u%u", "c%u:%u0000000000",
+	};
+	struct udev_device *ud;
+	char id[64];
+	size_t i;
+
+	snprintf(id, sizeof(id), "c%u:%u", major(devnum_a), minor(devnum_a));
+	ud = udev_device_new_from_device_id(udev, id);
+	CHECK(ud != NULL);
+	if (ud != NULL) {
+		CHECK(strcmp(udev_device_get_syspath(ud), CARD_A) == 0);
+		udev_device_unref(ud);
+	}
+
+	for (i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		snprintf(id, sizeof(id), malformed[i], major(devnum_a),
+		    minor(devnum_a));
+		errno = 0;
+		CHECK(udev_device_new_from_device_id(udev, id) == NULL);
+		CHECK(errno == EINVAL);
+	}
+	CHECK(udev_device_new_from_device_id(udev, "n 1") == NULL);
+	CHECK(udev_device_new_from_device_id(udev, "n-1") == NULL);
+}
+
+static void
+test_stale(struct udev *udev)
+{
+	struct udev_device *ud;
+
+	/* Wrong entry is caught by verification and replaced */
+	devnum_index_insert(devnum_b, CARD_A);
+	check_lookup(devnum_b, CARD_B);
+
+	/* Node replaced with another device number */
+	CHECK(fixture_unlink(CARD_A) == 0);
+	CHECK(fixture_link(CARD_A, FIXTURE_NODE_C) == 0);
+	check_lookup(devnum_a, NULL);
+	check_lookup(devnum_c, CARD_A);
+	ud = udev_device_new_from_syspath(udev, CARD_A);
+	CHECK(ud != NULL);
+	if (ud != NULL) {
+		CHECK(udev_device_get_devnum(ud) == devnum_c);
+		udev_device_unref(ud);
+	}
+
+	/* Dropped entries are found again by the slow path */
+	devnum_index_remove(CARD_A);
+	check_lookup(devnum_c, CARD_A);
+
+	/* Node removed */
+	CHECK(fixture_unlink(CARD_B) == 0);
+	check_lookup(devnum_b, NULL);
+	CHECK(udev_device_new_from_devnum(udev, 'c', devnum_b) == NULL);
+}
+
+int
+main(void)
+{
+	struct udev *udev;
+
+	if (fixtures_create() == -1) {
+		perror("fixture");
+		return (EXIT_FAILURE);
+	}
+
+	udev = udev_new();
+	if (udev == NULL)
+		return (EXIT_FAILURE);
+	test_enumerated(udev);
+	test_device_id(udev);
+	test_stale(udev);
+	udev_unref(udev);
+
+	return (failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udev-global.h"
+#include "test-fixture.h"
+
+static char fixture_root[] = "/tmp/udev-fixture.XXXXXX";
+
+static int
+fixture_remove_cb(const char *path, const struct stat *st, int flag,
+    struct FTW *ftw)
+{
+
+	remove(path);
+	return (0);
+}
+
+static void
+fixture_remove(void)
+{
+
+	nftw(fixture_root, fixture_remove_cb, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Creates empty fixture tree and makes the library read it */
+int
+fixture_init(void)
+{
+
+	if (mkdtemp(fixture_root) == NULL)
+		return (-1);
+	atexit(fixture_remove);
+	set_dev_root(fixture_root);
+
+	return (0);
+}
+
+/* Makes @p syspath refer to node @p target, creating directories */
+int
+fixture_link(const char *syspath, const char *target)
+{
+	char path[PATH_MAX];
+	char *slash;
+
+	/* Never touch anything outside of the fixture tree */
+	if (get_dev_fspath(syspath, path, sizeof(path)) != path) {
+		errno = EINVAL;
+		return (-1);
+	}
+	for (slash = strchr(path + strlen(fixture_root) + 1, '/');
+	     slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		if (mkdir(path, 0755) == -1 && errno != EEXIST)
+			return (-1);
+		*slash = '/';
+	}
+	if (unlink(path) == -1 && errno != ENOENT)
+		return (-1);
+
+	return (symlink(target, path));
+}
+
+int
+fixture_unlink(const char *syspath)
+{
+	char path[PATH_MAX];
+
+	/* Never touch anything outside of the fixture tree */
+	if (get_dev_fspath(syspath, path, sizeof(path)) != path) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	return (unlink(path));
+}
+
+/* Returns device number of real node @p target */
+dev_t
+fixture_devnum(const char *target)
+{
+	struct stat st;
+
+	if (stat(target, &st) != 0 || !S_ISCHR(st.st_mode)) {
+		perror(target);
+		exit(EXIT_FAILURE);
+	}
+
+	return (st.st_rdev);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TEST_FIXTURE_H_
+#define TEST_FIXTURE_H_
+
+/*
+ * Fixture device trees for tests. The tree is created in a temporary
+ * directory which the library reads in place of DEV_PATH_ROOT. Making
+ * device nodes needs privileges, so fixture nodes are symbolic links to
+ * real nodes which exist on every supported system.
+ */
+
+#define	FIXTURE_NODE_A	"/dev/null"
+#define	FIXTURE_NODE_B	"/dev/zero"
+#define	FIXTURE_NODE_C	"/dev/random"
+
+int fixture_init(void);
+int fixture_link(const char *syspath, const char *target);
+int fixture_unlink(const char *syspath);
+dev_t fixture_devnum(const char *target);
+
+#endif /* TEST_FIXTURE_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Checks that fnpattern_match() agrees with fnmatch(3) for every pattern
+ * and name of the corpus below, including the shapes it special-cases.
+ * The corpus is run in C locale and in the first available locale where
+ * bracket ranges may follow collation order rather than byte order.
+ */
+
+#include <fnmatch.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static const char *const patterns[] = {
+	"",
+	"*",
+	"**",
+	"?",
+	"event",
+	"event*",
+	"event[0-9]*",
+	"event[0-9]",
+	"event?*",
+	"ev*nt[0-9]*",
+	"[0-9]*",
+	"*0",
+	"*event0",
+	"*[0-9]",
+	"*.c",
+	"*\\*",
+	"\\*",
+	"a\\*",
+	"event\\[0-9]*",
+	"[!0-9]*",
+	"[a-z]*",
+	"card[0-9]*",
+	"/dev/input/event[0-9]*",
+	"/dev/*",
+	"*/event*",
+	"ID_INPUT_*",
+	"1",
+};
+
+static const char *const names[] = {
+	"",
+	"*",
+	"0",
+	"1",
+	"e",
+	"event",
+	"event0",
+	"event10",
+	"event0a",
+	"eventX",
+	"event*",
+	"event[0-9]",
+	"eevent0",
+	"a*",
+	"ab",
+	"x.c",
+	".c",
+	"card",
+	"card0",
+	"card0/event0",
+	"/dev/input/event3",
+	"/dev/input/event",
+	"/dev/dri/card0",
+	"ID_INPUT_KEYBOARD",
+	"ID_INPUT",
+	"event\xc3\xa9",
+	"event\xb2",
+};
+
+static const char *const locales[] = {
+	"C.UTF-8",
+	"en_US.UTF-8",
+	"en_US.ISO8859-1",
+	"de_DE.UTF-8",
+};
+
+/* Returns number of corpus entries fnpattern_match() gets wrong */
+static int
+run_corpus(const char *locale)
+{
+	struct fnpattern fnp;
+	size_t i, j;
+	int failed = 0;
+	bool expected;
+
+	for (i = 0; i < nitems(patterns); i++) {
+		fnpattern_compile(&fnp, patterns[i]);
+		for (j = 0; j < nitems(names); j++) {
+			expected = fnmatch(patterns[i], names[j], 0) == 0;
+			if (fnpattern_match(&fnp, names[j]) == expected)
+				continue;
+			fprintf(stderr, "%s: \"%s\" (type %d) %s \"%s\"\n",
+			    locale, patterns[i], fnp.type,
+			    expected ? "does not match" : "matches", names[j]);
+			failed++;
+		}
+	}
+
+	return (failed);
+}
+
+int
+main(void)
+{
+	struct fnpattern fnp;
+	size_t i;
+	int failed;
+
+	failed = run_corpus("C");
+	fnpattern_compile(&fnp, "event[0-9]*");
+	if (fnp.type != FNPATTERN_UNIT) {
+		fprintf(stderr, "C: unit pattern is not special-cased\n");
+		failed++;
+	}
+
+	for (i = 0; i < nitems(locales); i++) {
+		if (setlocale(LC_ALL, locales[i]) == NULL)
+			continue;
+		failed += run_corpus(locales[i]);
+		/* Ranges are left to fnmatch(3) outside of C locale */
+		fnpattern_compile(&fnp, "event[0-9]*");
+		if (fnp.type != FNPATTERN_GLOB) {
+			fprintf(stderr, "%s: unit pattern is special-cased\n",
+			    locales[i]);
+			failed++;
+		}
+		break;
+	}
+	if (i == nitems(locales))
+		printf("no locale besides C available\n");
+	setlocale(LC_ALL, "C");
+
+	printf("%zu patterns, %zu names, %d mismatches\n",
+	    nitems(patterns), nitems(names), failed);
+	return (failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
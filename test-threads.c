@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Stress test for devices shared between threads, meant to be run under
+ * ThreadSanitizer. Eight threads race on lazy probing, parent lookup,
+ * the device cache and reference counting of the same two devices of a
+ * fixture tree, and check what they get.
+ */
+
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libudev.h"
+#include "test-fixture.h"
+
+#define	NTHREADS	8
+#define	ITERATIONS	2000
+
+static const struct {
+	const char *syspath;
+	const char *target;
+} fixtures[] = {
+	{ "/dev/dri/card0", FIXTURE_NODE_A },
+	{ "/dev/dri/card1", FIXTURE_NODE_B },
+};
+
+#define	NFIXTURES	(sizeof(fixtures) / sizeof(fixtures[0]))
+
+static struct udev *udev;
+static struct udev_device *shared[NFIXTURES];
+static dev_t devnums[NFIXTURES];
+static atomic_int failed;
+
+#define	CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		atomic_fetch_add(&failed, 1);				\
+	}								\
+} while (0)
+
+static int
+fixtures_create(void)
+{
+	size_t i;
+
+	if (fixture_init() == -1)
+		return (-1);
+	for (i = 0; i < NFIXTURES; i++) {
+		if (fixture_link(fixtures[i].syspath, fixtures[i].target) == -1)
+			return (-1);
+		devnums[i] = fixture_devnum(fixtures[i].target);
+	}
+
+	return (0);
+}
+
+static void *
+worker(void *arg)
+{
+	struct udev_device *ud, *other;
+	struct udev_enumerate *ue;
+	size_t n;
+	int i;
+
+	for (i = 0; i < ITERATIONS; i++) {
+		n = (i + (size_t)arg) % NFIXTURES;
+		ud = udev_device_ref(shared[n]);
+		udev_device_get_property_value(ud, "DEVNAME");
+		udev_device_get_properties_list_entry(ud);
+		udev_device_get_sysattr_list_entry(ud);
+		CHECK(udev_device_get_devnum(ud) == devnums[n]);
+		udev_device_get_parent(ud);
+		udev_device_get_parent_with_subsystem_devtype(ud, "pci", NULL);
+
+		other = udev_device_new_from_syspath(udev, fixtures[n].syspath);
+		CHECK(other != NULL);
+		if (other != NULL) {
+			udev_device_get_tags_list_entry(other);
+			CHECK(udev_device_get_devnum(other) != 0);
+			CHECK(udev_device_get_devnum(other) ==
+			    udev_device_get_devnum(ud));
+			udev_device_unref(other);
+		}
+
+		if (i % 100 == 0) {
+			ue = udev_enumerate_new(udev);
+			CHECK(udev_enumerate_add_match_subsystem(ue,
+			    "drm") == 0);
+			CHECK(udev_enumerate_scan_devices(ue) == 0);
+			udev_enumerate_unref(ue);
+		}
+		udev_device_unref(ud);
+	}
+
+	return (NULL);
+}
+
+int
+main(void)
+{
+	pthread_t threads[NTHREADS];
+	size_t i;
+
+	if (fixtures_create() == -1) {
+		perror("fixture");
+		return (EXIT_FAILURE);
+	}
+
+	udev = udev_new();
+	if (udev == NULL)
+		return (EXIT_FAILURE);
+	/* Left unprobed, the first threads to touch them race on it */
+	for (i = 0; i < NFIXTURES; i++) {
+		shared[i] = udev_device_new_from_syspath(udev,
+		    fixtures[i].syspath);
+		if (shared[i] == NULL)
+			return (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < NTHREADS; i++)
+		if (pthread_create(&threads[i], NULL, worker,
+		    (void *)i) != 0)
+			return (EXIT_FAILURE);
+	for (i = 0; i < NTHREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < NFIXTURES; i++)
+		udev_device_unref(shared[i]);
+	udev_unref(udev);
+
+	return (atomic_load(&failed) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
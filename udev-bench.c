@@ -0,0 +1,975 @@
+/*
+ * Copyright (c) 2026 libudev-bsd contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Benchmarks of library internals. Each mode runs one workload for the
+ * given number of iterations and reports time per operation along with
+ * the context statistics counters. Not meant to be installed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libudev.h"
+#include "udev-global.h"
+
+struct bench {
+	const char *name;
+	int (*run)(unsigned int iterations);
+	unsigned int iterations;	/* default */
+	const char *descr;
+};
+
+static const char *const stat_names[UDEV_STAT_CNT] = {
+	[UDEV_STAT_FILTER_PROBES] = "filter probes",
+	[UDEV_STAT_FILTER_PROBES_AVOIDED] = "filter probes avoided",
+	[UDEV_STAT_SCAN_CACHE_HITS] = "scan cache hits",
+	[UDEV_STAT_SCAN_CACHE_MISSES] = "scan cache misses",
+	[UDEV_STAT_DEVICE_CACHE_HITS] = "device cache hits",
+	[UDEV_STAT_DEVICE_CACHE_MISSES] = "device cache misses",
+	[UDEV_STAT_DEVICE_PROBES] = "device probes",
+};
+
+static atomic_ulong stats[UDEV_STAT_CNT];
+
+/*
+ * Heap allocations are counted by wrapping malloc(3) family, which also
+ * sees allocations made by libc on behalf of the library. Symbols are
+ * resolved on first use, dlsym() may allocate meanwhile, so that is
+ * served from a static pool which is never freed.
+ */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static atomic_ulong allocs;
+static char pool[4096];
+static size_t pool_used;
+
+static void
+bench_resolve(void)
+{
+	static bool resolving;
+
+	if (resolving)
+		return;
+	resolving = true;
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	resolving = false;
+}
+
+static void *
+bench_pool_alloc(size_t size)
+{
+	void *ptr;
+
+	size = (size + 15) & ~(size_t)15;
+	if (size > sizeof(pool) - pool_used)
+		return (NULL);
+	ptr = pool + pool_used;
+	pool_used += size;
+	return (ptr);
+}
+
+void *
+malloc(size_t size)
+{
+
+	if (real_malloc == NULL)
+		bench_resolve();
+	if (real_malloc == NULL)
+		return (bench_pool_alloc(size));
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return (real_malloc(size));
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+
+	if (real_calloc == NULL)
+		bench_resolve();
+	if (real_calloc == NULL)
+		/* Static pool is zeroed */
+		return (bench_pool_alloc(nmemb * size));
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return (real_calloc(nmemb, size));
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+
+	if (real_realloc == NULL)
+		bench_resolve();
+	if (ptr == NULL)
+		atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return (real_realloc(ptr, size));
+}
+
+void
+free(void *ptr)
+{
+
+	if ((char *)ptr >= pool && (char *)ptr < pool + sizeof(pool))
+		return;
+	if (real_free == NULL)
+		bench_resolve();
+	real_free(ptr);
+}
+
+static uint64_t
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* Accumulates statistics of context @p udev about to be released */
+static void
+bench_stats_add(struct udev *udev)
+{
+	int i;
+
+	for (i = 0; i < UDEV_STAT_CNT; i++)
+		atomic_fetch_add(&stats[i], udev_get_stat(udev, i));
+}
+
+static void
+bench_report(const char *what, unsigned long ops, uint64_t ns)
+{
+
+	printf("  %-24s %8lu ops %12.1f ns/op\n", what, ops,
+	    ops != 0 ? (double)ns / ops : 0.0);
+}
+
+static void
+bench_stats_report(void)
+{
+	int i;
+
+	for (i = 0; i < UDEV_STAT_CNT; i++)
+		if (atomic_load(&stats[i]) != 0)
+			printf("  %-24s %8lu\n", stat_names[i],
+			    atomic_load(&stats[i]));
+}
+
+/* Returns syspaths of all devices found by a full scan */
+static int
+bench_scan_all(struct udev_list *ul)
+{
+	struct udev *udev;
+	struct udev_enumerate *ue;
+	struct udev_list_entry *ule;
+	int ret = -1;
+
+	udev = udev_new();
+	if (udev == NULL)
+		return (-1);
+	ue = udev_enumerate_new(udev);
+	if (ue != NULL && udev_enumerate_scan_devices(ue) == 0) {
+		ret = 0;
+		udev_list_entry_foreach(ule,
+		    udev_enumerate_get_list_entry(ue))
+			if (udev_list_insert(ul, udev_list_entry_get_name(ule),
+			    NULL) == -1)
+				ret = -1;
+	}
+	udev_enumerate_unref(ue);
+	udev_unref(udev);
+
+	return (ret);
+}
+
+static unsigned long
+bench_count(struct udev_list_entry *ule)
+{
+	unsigned long n = 0;
+
+	for (; ule != NULL; ule = udev_list_entry_get_next(ule))
+		n++;
+
+	return (n);
+}
+
+/*
+ * Synthetic /dev-like tree of regular files, so it can be made without
+ * privileges. Nodes are spread over directories roughly as on a desktop,
+ * the ones the library is interested in are a small part of them.
+ */
+#define	BENCH_TREE_NODES	10000
+
+static const struct {
+	const char *dir;	/* relative to the tree root, "" for root */
+	const char *fmt;
+	unsigned int share;	/* percent of nodes */
+} bench_tree_nodes[] = {
+	{ "input",	"event%u",	5 },
+	{ "dri",	"card%u",	1 },
+	{ "",		"hidraw%u",	2 },
+	{ "",		"psm%u",	1 },
+	{ "",		"ttyv%u",	10 },
+	{ "",		"ada0p%u",	20 },
+	{ "pts",	"%u",		20 },
+	{ "usb",	"ugen0.%u",	20 },
+	{ "fd",		"%u",		21 },
+};
+
+struct bench_tree {
+	char root[PATH_MAX];
+	unsigned int nodes;
+};
+
+static void
+bench_tree_destroy(struct bench_tree *bt)
+{
+	char path[PATH_MAX * 2];
+	unsigned int i, j, n;
+
+	for (i = 0; i < nitems(bench_tree_nodes); i++) {
+		n = bt->nodes * bench_tree_nodes[i].share / 100;
+		for (j = 0; j < n; j++) {
+			snprintf(path, sizeof(path), "%s/%s/", bt->root,
+			    bench_tree_nodes[i].dir);
+			snprintf(path + strlen(path), sizeof(path) - strlen(path),
+			    bench_tree_nodes[i].fmt, j);
+			unlink(path);
+		}
+		if (bench_tree_nodes[i].dir[0] != '\0') {
+			snprintf(path, sizeof(path), "%s/%s", bt->root,
+			    bench_tree_nodes[i].dir);
+			rmdir(path);
+		}
+	}
+	rmdir(bt->root);
+}
+
+static int
+bench_tree_create(struct bench_tree *bt, unsigned int nodes)
+{
+	char path[PATH_MAX * 2];
+	unsigned int i, j, n;
+	int fd;
+
+	snprintf(bt->root, sizeof(bt->root), "%s/udev-bench.XXXXXX",
+	    getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp");
+	if (mkdtemp(bt->root) == NULL)
+		return (-1);
+	bt->nodes = nodes;
+
+	for (i = 0; i < nitems(bench_tree_nodes); i++) {
+		if (bench_tree_nodes[i].dir[0] != '\0') {
+			snprintf(path, sizeof(path), "%s/%s", bt->root,
+			    bench_tree_nodes[i].dir);
+			if (mkdir(path, 0700) == -1 && errno != EEXIST)
+				goto fail;
+		}
+		n = nodes * bench_tree_nodes[i].share / 100;
+		for (j = 0; j < n; j++) {
+			snprintf(path, sizeof(path), "%s/%s/", bt->root,
+			    bench_tree_nodes[i].dir);
+			snprintf(path + strlen(path), sizeof(path) - strlen(path),
+			    bench_tree_nodes[i].fmt, j);
+			fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+			if (fd == -1)
+				goto fail;
+			close(fd);
+		}
+	}
+
+	return (0);
+fail:
+	bench_tree_destroy(bt);
+	return (-1);
+}
+
+struct bench_names {
+	size_t root_len;
+	size_t count;
+	char **paths;		/* as if the tree was mounted on /dev */
+	const char **sysnames;
+};
+
+static int
+bench_names_cb(int dirfd, const char *name, const char *path, mode_t type,
+    void *args)
+{
+	struct bench_names *bn = args;
+	char **paths;
+	const char **sysnames;
+	char *devpath;
+
+	if ((bn->count & (bn->count - 1)) == 0) {
+		paths = realloc(bn->paths,
+		    2 * (bn->count + 1) * sizeof(*paths));
+		sysnames = realloc(bn->sysnames,
+		    2 * (bn->count + 1) * sizeof(*sysnames));
+		if (paths != NULL)
+			bn->paths = paths;
+		if (sysnames != NULL)
+			bn->sysnames = sysnames;
+		if (paths == NULL || sysnames == NULL)
+			return (-1);
+	}
+	devpath = malloc(sizeof(DEV_PATH_ROOT) + strlen(path));
+	if (devpath == NULL)
+		return (-1);
+	strcpy(devpath, DEV_PATH_ROOT);
+	strcat(devpath, path + bn->root_len);
+	bn->paths[bn->count] = devpath;
+	bn->sysnames[bn->count] = strbase(devpath);
+	bn->count++;
+
+	return (0);
+}
+
+static void
+bench_names_free(struct bench_names *bn)
+{
+
+	while (bn->count > 0)
+		free(bn->paths[--bn->count]);
+	free(bn->paths);
+	free(bn->sysnames);
+}
+
+/* Collects paths of all nodes of @p bt */
+static int
+bench_names_collect(struct bench_tree *bt, struct bench_names *bn)
+{
+	struct scandir_ctx ctx = {
+		.recursive = true,
+		.cb = bench_names_cb,
+		.args = bn,
+	};
+
+	memset(bn, 0, sizeof(*bn));
+	bn->root_len = strlen(bt->root);
+	if (scandir_recursive(bt->root, &ctx) == -1) {
+		bench_names_free(bn);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Builds, reads and drops every device of the system once per iteration,
+ * each iteration in a context of its own so the device cache does not
+ * hide the cost.
+ */
+/* Builds, reads and drops every device of @p syspaths */
+static void
+bench_alloc_run(struct udev_list *syspaths, unsigned int iterations,
+    const char *label)
+{
+	struct udev_list_entry *ule;
+	struct udev *udev;
+	struct udev_device *ud;
+	unsigned long ndevs = 0, nentries = 0, nallocs;
+	unsigned int i;
+	uint64_t ns;
+
+	atomic_store(&allocs, 0);
+	ns = bench_now();
+	for (i = 0; i < iterations; i++) {
+		udev = udev_new();
+		if (udev == NULL)
+			break;
+		udev_list_entry_foreach(ule,
+		    udev_list_entry_get_first(syspaths)) {
+			ud = udev_device_new_from_syspath(udev,
+			    udev_list_entry_get_name(ule));
+			if (ud == NULL)
+				continue;
+			nentries += bench_count(
+			    udev_device_get_properties_list_entry(ud)) +
+			    bench_count(
+			    udev_device_get_sysattr_list_entry(ud)) +
+			    bench_count(udev_device_get_tags_list_entry(ud)) +
+			    bench_count(
+			    udev_device_get_devlinks_list_entry(ud));
+			udev_device_unref(ud);
+			ndevs++;
+		}
+		bench_stats_add(udev);
+		udev_unref(udev);
+	}
+	ns = bench_now() - ns;
+	nallocs = atomic_load(&allocs);
+
+	bench_report(label, ndevs, ns);
+	printf("  %-24s %8lu (%.1f per device)\n", "list entries", nentries,
+	    ndevs != 0 ? (double)nentries / ndevs : 0.0);
+	printf("  %-24s %8lu (%.1f per device)\n", "heap allocations",
+	    nallocs, ndevs != 0 ? (double)nallocs / ndevs : 0.0);
+}
+
+/*
+ * Compares heap allocations of devices with arena backed lists against
+ * lists allocating every entry with malloc(3).
+ */
+static int
+bench_alloc(unsigned int iterations)
+{
+	struct udev_list syspaths;
+
+	udev_list_init(&syspaths);
+	if (bench_scan_all(&syspaths) == -1) {
+		udev_list_free(&syspaths);
+		return (-1);
+	}
+
+	_udev_device_arena_lists = false;
+	bench_alloc_run(&syspaths, iterations, "malloc backed lists");
+	_udev_device_arena_lists = true;
+	bench_alloc_run(&syspaths, iterations, "arena backed lists");
+
+	udev_list_free(&syspaths);
+	return (0);
+}
+
+#define	BENCH_LIST_SIZE	32	/* properties of a typical input device */
+
+/* Looks every entry up by name and walks the list */
+static void
+bench_list_run(struct udev_list *ul, char names[][32], unsigned int n,
+    unsigned int iterations, const char *what)
+{
+	struct udev_list_entry *ule;
+	unsigned long found = 0, walked = 0;
+	unsigned int i, j;
+	uint64_t ns;
+	char label[64];
+
+	ns = bench_now();
+	for (i = 0; i < iterations; i++)
+		for (j = 0; j < n; j++)
+			found += udev_list_find(ul, names[j]) != NULL;
+	ns = bench_now() - ns;
+	snprintf(label, sizeof(label), "%s lookup", what);
+	bench_report(label, found, ns);
+
+	ns = bench_now();
+	for (i = 0; i < iterations; i++)
+		for (ule = udev_list_entry_get_first(ul); ule != NULL;
+		    ule = udev_list_entry_get_next(ule))
+			walked++;
+	ns = bench_now() - ns;
+	snprintf(label, sizeof(label), "%s iteration", what);
+	bench_report(label, walked, ns);
+}
+
+/* Compares tree and frozen array representations of a device list */
+static int
+bench_list(unsigned int iterations)
+{
+	char names[BENCH_LIST_SIZE][32];
+	struct udev_list ul;
+	struct arena arena;
+	unsigned int i;
+	int ret = 0;
+
+	arena_init(&arena, NULL, 0);
+	udev_list_init_arena(&ul, &arena);
+	for (i = 0; i < BENCH_LIST_SIZE && ret == 0; i++) {
+		snprintf(names[i], sizeof(names[i]), "ID_PROPERTY_%02u", i);
+		ret = udev_list_insert(&ul, names[i], "1");
+	}
+
+	if (ret == 0) {
+		bench_list_run(&ul, names, BENCH_LIST_SIZE, iterations,
+		    "tree");
+		ret = udev_list_freeze(&ul);
+	}
+	if (ret == 0)
+		bench_list_run(&ul, names, BENCH_LIST_SIZE, iterations,
+		    "frozen");
+
+	udev_list_free(&ul);
+	arena_free(&arena);
+	return (ret);
+}
+
+/* Sysname patterns of the shapes applications use in filters */
+static const char *const bench_match_patterns[] = {
+	"event[0-9]*",
+	"card[0-9]*",
+	"input",
+	"ttyv*",
+	"*p1",
+	"hid*[0-9]",
+};
+
+/*
+ * Matches nodes of a synthetic tree against filter patterns with
+ * fnmatch(3) and with compiled matchers, and then runs the nodes through
+ * filters of a typical input device enumerator.
+ */
+static int
+bench_match(unsigned int iterations)
+{
+	struct fnpattern fnp[nitems(bench_match_patterns)];
+	struct udev_filter_head ufh;
+	struct bench_tree bt;
+	struct bench_names bn;
+	struct udev *udev;
+	unsigned long ops, matched[2] = { 0, 0 };
+	unsigned int i;
+	size_t j, k;
+	uint64_t ns;
+
+	if (bench_tree_create(&bt, BENCH_TREE_NODES) == -1)
+		return (-1);
+	if (bench_names_collect(&bt, &bn) == -1) {
+		bench_tree_destroy(&bt);
+		return (-1);
+	}
+	printf("  %-24s %8zu\n", "tree nodes", bn.count);
+
+	ops = (unsigned long)iterations * bn.count *
+	    nitems(bench_match_patterns);
+	ns = bench_now();
+	for (i = 0; i < iterations; i++)
+		for (j = 0; j < nitems(bench_match_patterns); j++)
+			for (k = 0; k < bn.count; k++)
+				matched[0] += fnmatch(bench_match_patterns[j],
+				    bn.sysnames[k], 0) == 0;
+	ns = bench_now() - ns;
+	bench_report("fnmatch", ops, ns);
+
+	for (j = 0; j < nitems(bench_match_patterns); j++)
+		fnpattern_compile(&fnp[j], bench_match_patterns[j]);
+	ns = bench_now();
+	for (i = 0; i < iterations; i++)
+		for (j = 0; j < nitems(bench_match_patterns); j++)
+			for (k = 0; k < bn.count; k++)
+				matched[1] += fnpattern_match(&fnp[j],
+				    bn.sysnames[k]);
+	ns = bench_now() - ns;
+	bench_report("fnpattern_match", ops, ns);
+	if (matched[0] != matched[1])
+		fprintf(stderr, "match counts differ: %lu != %lu\n",
+		    matched[0], matched[1]);
+
+	udev = udev_new();
+	udev_filter_init(&ufh);
+	if (udev == NULL ||
+	    udev_filter_add(&ufh, UDEV_FILTER_TYPE_SUBSYSTEM, 0, "input",
+	    NULL) == -1 ||
+	    udev_filter_add(&ufh, UDEV_FILTER_TYPE_SYSNAME, 0, "event*",
+	    NULL) == -1) {
+		udev_filter_free(&ufh);
+		bench_names_free(&bn);
+		bench_tree_destroy(&bt);
+		return (-1);
+	}
+	ns = bench_now();
+	for (i = 0; i < iterations; i++)
+		for (k = 0; k < bn.count; k++)
+			udev_filter_match(udev, &ufh, bn.paths[k],
+			    UD_ACTION_NONE, NULL);
+	ns = bench_now() - ns;
+	bench_report("udev_filter_match", (unsigned long)iterations *
+	    bn.count, ns);
+	bench_stats_add(udev);
+
+	udev_filter_free(&ufh);
+	udev_unref(udev);
+	bench_names_free(&bn);
+	bench_tree_destroy(&bt);
+	return (0);
+}
+
+/*
+ * Scans devices in a fresh context, so the scan cache does not answer it,
+ * with @p nthreads threads. Property filter makes every candidate probed.
+ */
+static int
+bench_scan_once(unsigned int nthreads, const char *property,
+    unsigned long *found)
+{
+	struct udev *udev;
+	struct udev_enumerate *ue;
+	int ret = -1;
+
+	udev = udev_new();
+	if (udev == NULL)
+		return (-1);
+	ue = udev_enumerate_new(udev);
+	if (ue != NULL &&
+	    udev_enumerate_set_parallel(ue, nthreads) == 0 &&
+	    (property == NULL ||
+	     udev_enumerate_add_match_property(ue, property, "*") == 0) &&
+	    udev_enumerate_scan_devices(ue) == 0) {
+		*found += bench_count(udev_enumerate_get_list_entry(ue));
+		ret = 0;
+	}
+	udev_enumerate_unref(ue);
+	bench_stats_add(udev);
+	udev_unref(udev);
+
+	return (ret);
+}
+
+#define	BENCH_SCAN_THREADS	4
+
+/* Compares serial and parallel scans, plain and probing every device */
+static int
+bench_scan(unsigned int iterations)
+{
+	static const struct {
+		const char *what;
+		unsigned int nthreads;
+		const char *property;
+	} runs[] = {
+		{ "serial scan", 1, NULL },
+		{ "parallel scan", BENCH_SCAN_THREADS, NULL },
+		{ "serial scan and probe", 1, "HOTPLUG" },
+		{ "parallel scan and probe", BENCH_SCAN_THREADS, "HOTPLUG" },
+	};
+	unsigned long found;
+	unsigned int i;
+	size_t j;
+	uint64_t ns;
+
+	for (j = 0; j < nitems(runs); j++) {
+		found = 0;
+		ns = bench_now();
+		for (i = 0; i < iterations; i++)
+			if (bench_scan_once(runs[j].nthreads, runs[j].property,
+			    &found) == -1)
+				return (-1);
+		ns = bench_now() - ns;
+		bench_report(runs[j].what, iterations, ns);
+		printf("  %-24s %8lu per scan\n", "devices found",
+		    found / iterations);
+	}
+
+	return (0);
+}
+
+struct bench_contend_args {
+	unsigned int iterations;
+	unsigned long found;
+	int ret;
+};
+
+static void *
+bench_contend_worker(void *arg)
+{
+	struct bench_contend_args *args = arg;
+	unsigned int i;
+
+	for (i = 0; i < args->iterations && args->ret == 0; i++)
+		args->ret = bench_scan_once(1, NULL, &args->found);
+
+	return (NULL);
+}
+
+#define	BENCH_CONTEND_THREADS_MAX	8
+
+/*
+ * Runs independent enumerators, each in a context of its own as separate
+ * libraries of one process would do, on growing number of threads.
+ */
+static int
+bench_contend(unsigned int iterations)
+{
+	struct bench_contend_args args[BENCH_CONTEND_THREADS_MAX];
+	pthread_t threads[BENCH_CONTEND_THREADS_MAX];
+	unsigned int i, n;
+	uint64_t ns;
+	char label[64];
+	int ret = 0;
+
+	for (n = 1; n <= BENCH_CONTEND_THREADS_MAX && ret == 0; n *= 2) {
+		ns = bench_now();
+		for (i = 0; i < n; i++) {
+			args[i].iterations = iterations;
+			args[i].found = 0;
+			args[i].ret = 0;
+			if (pthread_create(&threads[i], NULL,
+			    bench_contend_worker, &args[i]) != 0)
+				break;
+		}
+		n = i;
+		for (i = 0; i < n; i++) {
+			pthread_join(threads[i], NULL);
+			if (args[i].ret != 0)
+				ret = -1;
+		}
+		ns = bench_now() - ns;
+		/* Wall time per scan, so it stays flat without contention */
+		snprintf(label, sizeof(label), "%u threads", n);
+		bench_report(label, iterations, ns);
+		if (n == 0)
+			ret = -1;
+	}
+
+	return (ret);
+}
+
+/*
+ * Repeats the same scan on one context. Every scan is a miss when a device
+ * event arrives in between. Without a monitor, a scan reading /dev only
+ * is validated with directory stamps, with a monitor by its generation.
+ */
+static int
+bench_cache(unsigned int iterations)
+{
+	static const struct {
+		const char *what;
+		const char *subsystem;
+		bool watch;
+		bool event;
+	} runs[] = {
+		{ "event between scans", "drm", true, true },
+		{ "unwatched, drm only", "drm", false, false },
+		{ "watched, drm only", "drm", true, false },
+		{ "watched, all sources", NULL, true, false },
+	};
+	struct udev *udev;
+	struct udev_enumerate *ue;
+	unsigned int i;
+	size_t j;
+	uint64_t ns;
+	int ret = 0;
+
+	for (j = 0; j < nitems(runs) && ret == 0; j++) {
+		udev = udev_new();
+		if (udev == NULL)
+			return (-1);
+		ue = udev_enumerate_new(udev);
+		if (ue == NULL ||
+		    (runs[j].subsystem != NULL &&
+		     udev_enumerate_add_match_subsystem(ue,
+		     runs[j].subsystem) == -1)) {
+			ret = -1;
+			goto next;
+		}
+		/* Stands for a monitor connected to devd */
+		if (runs[j].watch)
+			_udev_watch(udev, true);
+
+		ns = bench_now();
+		for (i = 0; i < iterations && ret == 0; i++) {
+			if (runs[j].event)
+				_udev_generation_bump(udev);
+			ret = udev_enumerate_scan_devices(ue);
+		}
+		ns = bench_now() - ns;
+		bench_report(runs[j].what, iterations, ns);
+		printf("  %-24s %8lu of %u\n", "cache hits",
+		    udev_get_stat(udev, UDEV_STAT_SCAN_CACHE_HITS), iterations);
+
+		if (runs[j].watch)
+			_udev_watch(udev, false);
+next:
+		udev_enumerate_unref(ue);
+		bench_stats_add(udev);
+		udev_unref(udev);
+	}
+
+	return (ret);
+}
+
+/* Reference walk opening directories and stating nodes by full path */
+static int
+bench_walk_paths(char *path, size_t off, unsigned long *nodes)
+{
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir;
+	size_t len;
+	int ret = 0;
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return (-1);
+	while (ret == 0 && (ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 ||
+		    strcmp(ent->d_name, "..") == 0)
+			continue;
+		len = strlen(ent->d_name);
+		if (off + len + 2 > PATH_MAX)
+			continue;
+		memcpy(path + off, ent->d_name, len + 1);
+		if (ent->d_type == DT_DIR) {
+			strcpy(path + off + len, "/");
+			ret = bench_walk_paths(path, off + len + 1, nodes);
+		} else if (lstat(path, &st) == 0)
+			(*nodes)++;
+	}
+	path[off] = '\0';
+	closedir(dir);
+
+	return (ret);
+}
+
+struct bench_walk_args {
+	bool stat;		/* fstatat() every node as well */
+	unsigned long nodes;
+	unsigned long stats;
+};
+
+static int
+bench_walk_cb(int dirfd, const char *name, const char *path, mode_t type,
+    void *arg)
+{
+	struct bench_walk_args *args = arg;
+	struct stat st;
+
+	if (args->stat) {
+		args->stats++;
+		if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+			args->nodes++;
+	} else if (type != 0)
+		args->nodes++;
+
+	return (0);
+}
+
+/*
+ * Walks a synthetic tree the way device enumeration does: by full paths
+ * stating every node, with scandir_recursive() stating every node relative
+ * to directory descriptors, and with scandir_recursive() relying on d_type.
+ */
+static int
+bench_walk(unsigned int iterations)
+{
+	struct bench_tree bt;
+	struct bench_walk_args args;
+	struct scandir_ctx ctx = {
+		.recursive = true,
+		.cb = bench_walk_cb,
+		.args = &args,
+	};
+	char path[PATH_MAX + 1];
+	unsigned long nodes = 0;
+	unsigned int i;
+	uint64_t ns;
+	int j, ret = 0;
+
+	if (bench_tree_create(&bt, BENCH_TREE_NODES) == -1)
+		return (-1);
+	snprintf(path, sizeof(path), "%s/", bt.root);
+
+	ns = bench_now();
+	for (i = 0; i < iterations && ret == 0; i++)
+		ret = bench_walk_paths(path, strlen(path), &nodes);
+	ns = bench_now() - ns;
+	bench_report("full path walk", nodes, ns);
+	printf("  %-24s %8lu\n", "stat calls", nodes);
+
+	for (j = 1; j >= 0 && ret == 0; j--) {
+		args = (struct bench_walk_args){ .stat = j };
+		ns = bench_now();
+		for (i = 0; i < iterations && ret == 0; i++)
+			ret = scandir_recursive(bt.root, &ctx);
+		ns = bench_now() - ns;
+		bench_report(args.stat ? "scandir, fstatat" :
+		    "scandir, d_type", args.nodes, ns);
+		printf("  %-24s %8lu\n", "stat calls", args.stats);
+	}
+
+	bench_tree_destroy(&bt);
+	return (ret);
+}
+
+static const struct bench benches[] = {
+	{ "alloc", bench_alloc, 10,
+	    "build, read and drop every device, count allocations" },
+	{ "list", bench_list, 100000,
+	    "look up and walk a device list before and after freezing" },
+	{ "match", bench_match, 10,
+	    "match 10k node synthetic tree against filter patterns" },
+	{ "scan", bench_scan, 100,
+	    "scan devices serially and in parallel" },
+	{ "cache", bench_cache, 1000,
+	    "repeat the same scan with and without a monitor" },
+	{ "contend", bench_contend, 100,
+	    "scan devices on 1 to 8 threads at once" },
+	{ "walk", bench_walk, 10,
+	    "walk 10k node synthetic tree" },
+};
+
+static void
+usage(void)
+{
+	size_t i;
+
+	fprintf(stderr, "usage: udev-bench mode [iterations]\n");
+	for (i = 0; i < nitems(benches); i++)
+		fprintf(stderr, "  %-10s %s\n", benches[i].name,
+		    benches[i].descr);
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct bench *b = NULL;
+	unsigned int iterations;
+	size_t i;
+
+	if (argc < 2 || argc > 3)
+		usage();
+	for (i = 0; i < nitems(benches) && b == NULL; i++)
+		if (strcmp(benches[i].name, argv[1]) == 0)
+			b = &benches[i];
+	if (b == NULL)
+		usage();
+	iterations = argc == 3 ? strtoul(argv[2], NULL, 10) : b->iterations;
+	if (iterations == 0)
+		usage();
+
+	printf("%s: %u iterations\n", b->name, iterations);
+	if (b->run(iterations) == -1) {
+		perror(b->name);
+		return (EXIT_FAILURE);
+	}
+	bench_stats_report();
+
+	return (EXIT_SUCCESS);
+}
@@ -35,15 +35,16 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #if defined(__NetBSD__)
 #include <ndevd.h>
-#include <pthread.h>
 #include <sys/queue.h>
 #include <sys/ioctl.h>
 #include <dev/usb/usb.h>
@@ -283,7 +284,7 @@ is_fido(const char *path)
 
 	memset(&ucrd, 0, sizeof(ucrd));
 
-	if ((devfd = open(path, O_RDWR)) == -1) {
+	if ((devfd = dev_open(path, O_RDWR)) == -1) {
 		return false;
 	}
 
@@ -310,51 +311,143 @@ not_fido:
 }
 #endif
 
+#define	DEV_SCAN_GLOBS_MAX	32
+
+struct dev_scan_args {
+	struct udev_enumerate *ue;
+	struct fnpattern names[DEV_SCAN_GLOBS_MAX];
+	size_t nnames;
+};
+
 static int
-udev_dev_enumerate_cb(const char *path, mode_t type, void *arg)
+udev_dev_enumerate_cb(int dirfd, const char *name, const char *path,
+    mode_t type, void *arg)
 {
-	struct udev_enumerate *ue = arg;
+	struct dev_scan_args *args = arg;
 	const char *syspath;
+	size_t i;
+
+	if (!S_ISLNK(type) && !S_ISCHR(type))
+		return (0);
+
+	for (i = 0; i < args->nnames; i++)
+		if (fnpattern_match(&args->names[i], name))
+			break;
+	if (i == args->nnames)
+		return (0);
 
-	if (S_ISLNK(type) || S_ISCHR(type)) {
-		syspath = get_syspath_by_devpath(path);
+	syspath = get_syspath_by_devpath(path);
 #if defined(__NetBSD__)
-		if ((strstr(syspath, "uhid") != NULL) && (!is_fido(syspath))) {
-			return (0);
-		}
-#endif
-		return (udev_enumerate_add_device(ue, syspath));
+	if ((strstr(syspath, "uhid") != NULL) && (!is_fido(syspath))) {
+		return (0);
 	}
-	return (0);
+#endif
+	/* Feed devnum index, so lookups by devnum do not walk /dev */
+	devnum_index_note(syspath);
+	return (udev_enumerate_add_device(args->ue, syspath));
 }
 
+/*
+ * Only directories holding nodes of subsystems accepted by the enumerator
+ * filters are read, and only entries matching the subsystem syspath globs
+ * are passed further.
+ */
 int
 udev_dev_enumerate(struct udev_enumerate *ue)
 {
-	char path[DEV_PATH_MAX] = DEV_PATH_ROOT "/";
+	char path[DEV_PATH_MAX];
+	const char *globs[DEV_SCAN_GLOBS_MAX];
+	struct dev_scan_args args = {
+		.ue = ue,
+	};
 	struct scandir_ctx ctx = {
-		.recursive = true,
+		.recursive = false,
 		.cb = udev_dev_enumerate_cb,
-		.args = ue,
+		.args = &args,
 	};
+	size_t nglobs, dirlen, i, j;
+	int ret = 0;
+
+	nglobs = get_dev_syspath_globs(udev_enumerate_get_filters(ue), globs,
+	    nitems(globs));
+	for (i = 0; i < nglobs && ret == 0; i++) {
+		if (globs[i] == NULL)
+			continue;
+
+		/* Collect basename globs of all entries of the directory */
+		dirlen = strbase(globs[i]) - globs[i];
+		args.nnames = 0;
+		for (j = i; j < nglobs; j++) {
+			if (globs[j] == NULL ||
+			    strbase(globs[j]) - globs[j] != dirlen ||
+			    strncmp(globs[j], globs[i], dirlen) != 0)
+				continue;
+			fnpattern_compile(&args.names[args.nnames++],
+			    strbase(globs[j]));
+			if (j != i)
+				globs[j] = NULL;
+		}
+
+		if (dirlen >= sizeof(path))
+			continue;
+		strlcpy(path, globs[i], dirlen + 1);
+		ret = scandir_dev(path, &ctx);
+	}
 
-	return (scandir_recursive(path, sizeof(path), &ctx));
+	return (ret);
 }
 
-#if defined(__OpenBSD__)
-int
-udev_fido_enumerate(struct udev_enumerate *ue)
+/*
+ * Returns fingerprint of modification times of directories which would be
+ * read by udev_dev_enumerate() with given filters. Used to validate cached
+ * results while no monitor is watching, at the cost of one stat() per
+ * directory instead of a walk.
+ */
+uint64_t
+udev_dev_stamp(struct udev_filter_head *ufh)
 {
-	char path[DEV_PATH_MAX] = DEV_PATH_ROOT "/fido/";
-	struct scandir_ctx ctx = {
-		.recursive = true,
-		.cb = udev_dev_enumerate_cb,
-		.args = ue,
-	};
+	char path[DEV_PATH_MAX];
+	const char *globs[DEV_SCAN_GLOBS_MAX];
+	struct stat st;
+	struct timespec now;
+	uint64_t stamp = 14695981039346656037ull;
+	size_t nglobs, dirlen, i, j;
+
+	if (clock_gettime(CLOCK_REALTIME, &now) != 0)
+		return (0);
+
+	nglobs = get_dev_syspath_globs(ufh, globs, nitems(globs));
+	for (i = 0; i < nglobs; i++) {
+		dirlen = strbase(globs[i]) - globs[i];
+		if (dirlen >= sizeof(path))
+			continue;
+		for (j = 0; j < i; j++)
+			if (strbase(globs[j]) - globs[j] == dirlen &&
+			    strncmp(globs[j], globs[i], dirlen) == 0)
+				break;
+		if (j < i)
+			continue;
+		strlcpy(path, globs[i], dirlen + 1);
+		/*
+		 * Fallback for directories modified within the last second:
+		 * timestamps of some file systems have one second granularity,
+		 * so another change made within the same second would leave
+		 * the stamp unchanged. Such a result is not cached, and scans
+		 * are repeated until the directory has been quiet for a
+		 * second. With a monitor running, generation is used instead.
+		 */
+		if (dev_stat(path, &st) != 0)
+			memset(&st, 0, sizeof(st));
+		else if (st.st_mtim.tv_sec >= now.tv_sec - 1)
+			return (0);
+		/* FNV-1a over inode and mtime */
+		stamp = (stamp ^ (uint64_t)st.st_ino) * 1099511628211ull;
+		stamp = (stamp ^ (uint64_t)st.st_mtim.tv_sec) * 1099511628211ull;
+		stamp = (stamp ^ (uint64_t)st.st_mtim.tv_nsec) * 1099511628211ull;
+	}
 
-	return (scandir_recursive(path, sizeof(path), &ctx));
+	return (stamp != 0 ? stamp : 1);
 }
-#endif
 
 #if defined(__FreeBSD__) || defined(__DragonFly__)
 int
@@ -461,22 +554,18 @@ set_input_device_type(struct udev_device *ud, int input_type)
 	return (0);
 }
 
-static struct udev_device *
-create_xorg_parent(struct udev_device *ud, const char* sysname,
+static int
+set_xorg_parent(struct udev_device *ud, const char* sysname,
     const char *name, const char *product, const char *pnp_id)
 {
-	struct udev_device *parent;
-	struct udev *udev;
 	struct udev_list *props, *sysattrs;
 
 	/* xorg-server gets device name and vendor string from parent device */
-	udev = udev_device_get_udev(ud);
-	parent = udev_device_new_common(udev, sysname, UD_ACTION_NONE);
-	if (parent == NULL)
-		return NULL;
+	if (udev_device_set_parent_sysname(ud, sysname) == -1)
+		return (-1);
 
-	props = udev_device_get_properties_list(parent);
-	sysattrs = udev_device_get_sysattr_list(parent);
+	props = udev_device_get_parent_properties_list(ud);
+	sysattrs = udev_device_get_parent_sysattr_list(ud);
 	udev_list_insert(props, "NAME", name);
 	udev_list_insert(sysattrs, "name", name);
 	if (product != NULL)
@@ -484,7 +573,83 @@ create_xorg_parent(struct udev_device *ud, const char* sysname,
 	if (pnp_id != NULL)
 		udev_list_insert(sysattrs, "id", product);
 
-	return (parent);
+	return (0);
+}
+
+/*
+ * Parents of kbdmux, sysmouse and drm devices have constant properties.
+ * They are built once and referenced by parent lists copy-on-write.
+ */
+enum {
+	XP_KBDMUX,
+	XP_SYSMOUSE,
+	XP_DRM,
+};
+
+struct xorg_parent_tmpl {
+	const char *name;
+	const char *product;
+	struct udev_list props;
+	struct udev_list sysattrs;
+};
+
+static struct xorg_parent_tmpl xorg_parent_tmpls[] = {
+	[XP_KBDMUX] = {
+		.name = "System keyboard multiplexor",
+		.product = "6/1/1/0",
+	},
+	[XP_SYSMOUSE] = {
+		.name = "System mouse",
+		.product = "6/2/1/0",
+	},
+	[XP_DRM] = {
+		.name = "drm parent",
+	},
+};
+
+#define	XORG_PARENT_ARENA_SIZE	2048
+static char xorg_parent_buf[XORG_PARENT_ARENA_SIZE];
+static struct arena xorg_parent_arena;
+static pthread_once_t xorg_parent_once = PTHREAD_ONCE_INIT;
+
+static void
+xorg_parent_tmpl_init(void)
+{
+	struct xorg_parent_tmpl *xpt;
+	size_t i;
+
+	/* Templates live as long as the process, the arena is never freed */
+	arena_init(&xorg_parent_arena, xorg_parent_buf, sizeof(xorg_parent_buf));
+	for (i = 0; i < nitems(xorg_parent_tmpls); i++) {
+		xpt = &xorg_parent_tmpls[i];
+		udev_list_init_arena(&xpt->props, &xorg_parent_arena);
+		udev_list_init_arena(&xpt->sysattrs, &xorg_parent_arena);
+		udev_list_insert(&xpt->props, "NAME", xpt->name);
+		udev_list_insert(&xpt->sysattrs, "name", xpt->name);
+		if (xpt->product != NULL)
+			udev_list_insert(&xpt->props, "PRODUCT", xpt->product);
+		udev_list_freeze(&xpt->props);
+		udev_list_freeze(&xpt->sysattrs);
+	}
+}
+
+static int
+set_xorg_parent_shared(struct udev_device *ud, const char *sysname,
+    int tmpl)
+{
+	struct xorg_parent_tmpl *xpt;
+
+	pthread_once(&xorg_parent_once, xorg_parent_tmpl_init);
+	xpt = &xorg_parent_tmpls[tmpl];
+	if (udev_device_set_parent_sysname(ud, sysname) == -1)
+		return (-1);
+
+	udev_list_share(udev_device_get_parent_properties_list(ud),
+	    &xpt->props);
+	udev_list_share(udev_device_get_parent_sysattr_list(ud),
+	    &xpt->sysattrs);
+
+	return (0);
 }
 
 #ifdef HAVE_LINUX_INPUT_H
@@ -513,7 +678,6 @@ bit_find(const unsigned long *array, int start, int stop)
 void
 create_evdev_handler(struct udev_device *ud)
 {
-	struct udev_device *parent;
 	const char *sysname;
 	char name[80], product[80], phys[80];
 	int fd = -1, input_type = IT_NONE;
@@ -581,7 +745,7 @@ use_ioctl:
 	ERR("sysctl not found, opening device and using ioctl");
 #endif
 
-	fd = open(udev_device_get_devnode(ud), O_RDONLY | O_CLOEXEC);
+	fd = dev_open(udev_device_get_devnode(ud), O_RDONLY | O_CLOEXEC);
 	if (fd == -1) {
 		fd = path_to_fd(udev_device_get_devnode(ud));
 	} else {
@@ -687,9 +851,7 @@ detected:
 	snprintf(product, sizeof(product), "%x/%x/%x/%x",
 	    id.bustype, id.vendor, id.product, id.version);
 
-	parent = create_xorg_parent(ud, sysname, name, product, NULL);
-	if (parent != NULL)
-		udev_device_set_parent(ud, parent);
+	set_xorg_parent(ud, sysname, name, product, NULL);
 
 bail_out:
 	if (opened)
@@ -700,7 +862,6 @@ bail_out:
 static void
 set_parent(struct udev_device *ud)
 {
-	struct udev_device *parent;
 	const char *sysname;
 	char product[80], name[80];
 	char *pnp_id = NULL;
@@ -772,9 +933,7 @@ set_parent(struct udev_device *ud)
 	strlcpy(name, sysname, sizeof(name));
 #endif
 	snprintf(product, sizeof(product), "%x/%x/%x/0", bus, vendor, prod);
-	parent = create_xorg_parent(ud, sysname, name, product, pnp_id);
-	if (parent != NULL)
-		udev_device_set_parent(ud, parent);
+	set_xorg_parent(ud, sysname, name, product, pnp_id);
 
 	return;
 }
@@ -808,29 +967,21 @@ create_mouse_handler(struct udev_device *ud)
 void
 create_kbdmux_handler(struct udev_device *ud)
 {
-	struct udev_device *parent;
 	const char* sysname;
 
 	set_input_device_type(ud, IT_KEYBOARD);
 	sysname = _udev_device_get_sysname(ud);
-	parent = create_xorg_parent(ud, sysname,
-	    "System keyboard multiplexor", "6/1/1/0", NULL);
-	if (parent != NULL)
-		udev_device_set_parent(ud, parent);
+	set_xorg_parent_shared(ud, sysname, XP_KBDMUX);
 }
 
 void
 create_sysmouse_handler(struct udev_device *ud)
 {
-	struct udev_device *parent;
 	const char* sysname;
 
 	set_input_device_type(ud, IT_MOUSE);
 	sysname = _udev_device_get_sysname(ud);
-	parent = create_xorg_parent(ud, sysname,
-	    "System mouse", "6/2/1/0", NULL);
-	if (parent != NULL)
-		udev_device_set_parent(ud, parent);
+	set_xorg_parent_shared(ud, sysname, XP_SYSMOUSE);
 }
 
 void
@@ -861,9 +1012,10 @@ void
 create_drm_handler(struct udev_device *ud)
 {
 	const char *sysname, *devpath;
-	struct udev_device *parent;
 #ifdef HAVE_SYSCTLBYNAME
-	char devbuf[PATH_MAX], buf[32], busid[32], *devbufptr;
+	char devbuf[PATH_MAX], fsbuf[PATH_MAX], buf[32], busid[32];
+	const char *fspath;
+	char *devbufptr;
 	size_t buflen = sizeof(devbuf), busid_len = sizeof(busid);
 	int cardnum;
 #endif
@@ -874,14 +1026,13 @@ create_drm_handler(struct udev_device *ud)
 		return;
 
 	sysname = _udev_device_get_sysname(ud);
-	parent = create_xorg_parent(ud, sysname, "drm parent", NULL, NULL);
-	if (parent == NULL)
+	if (set_xorg_parent_shared(ud, sysname, XP_DRM) == -1)
 		return;
 
-	udev_device_set_parent(ud, parent);
-
 #ifdef HAVE_SYSCTLBYNAME
-	realpath(devpath, devbuf);
+	fspath = get_dev_fspath(devpath, fsbuf, sizeof(fsbuf));
+	if (fspath == NULL || realpath(fspath, devbuf) == NULL)
+		return;
 	devbufptr = devbuf + 1;
 	devbufptr = strchrnul(devbufptr, '/');
 	while (*devbufptr != '\0') {
@@ -890,11 +1041,12 @@ create_drm_handler(struct udev_device *ud)
 	}
 	snprintf(buf, sizeof(buf), "%.24s.PCI_ID", devbuf + 1);
 	if (sysctlbyname(buf, devbuf, &buflen, NULL, 0) == 0){
-		udev_list_insert(
-		    udev_device_get_properties_list(parent), "PCI_ID", devbuf);}
+		udev_list_insert(udev_device_get_parent_properties_list(ud),
+		    "PCI_ID", devbuf);}
 
 	/* Get the hw.dri.<cardnum>.busid entry */
-	realpath(devpath, devbuf);
+	if (realpath(fspath, devbuf) == NULL)
+		return;
 #if defined(__DragonFly__)
 	if (sscanf(devbuf, "/dev/dri/card%d", &cardnum) != 1)
 #else
@@ -922,15 +1074,13 @@ create_hidraw_handler(struct udev_device *ud)
 	const char *sysname;
 	char *uevent;
 	struct hidraw_devinfo info;
-	struct udev_device *parent;
-	struct udev *udev;
 	struct udev_list *sysattrs;
 	int fd = -1;
 	bool opened = false;
 
 	fd = path_to_fd(udev_device_get_devnode(ud));
 	if (fd == -1) {
-		fd = open(udev_device_get_devnode(ud), O_RDONLY | O_CLOEXEC);
+		fd = dev_open(udev_device_get_devnode(ud), O_RDONLY | O_CLOEXEC);
 		opened = true;
 	}
 	if (fd == -1)
@@ -945,13 +1095,10 @@ create_hidraw_handler(struct udev_device *ud)
 	}
 
 	sysname = phys[0] == 0 ? virtual_sysname : phys;
-	udev = udev_device_get_udev(ud);
-	parent = udev_device_new_common(udev, sysname, UD_ACTION_NONE);
-	if (parent == NULL)
+	if (udev_device_set_parent_sysname(ud, sysname) == -1)
 		goto bail_out;
 
-	udev_device_set_parent(ud, parent);
-	sysattrs = udev_device_get_sysattr_list(parent);
+	sysattrs = udev_device_get_parent_sysattr_list(ud);
 	asprintf(&uevent,
 	    "HID_ID=%04X:%08X:%08X\nHID_NAME=%s\nHID_PHYS=%s\nHID_UNIQ=%s",
 	    info.bustype, info.vendor, info.product, name, phys, uniq);
@@ -28,6 +28,8 @@
 
 #include "config.h"
 
+#include <stdint.h>
+
 #include "udev-utils.h"
 #if defined(__NetBSD__)
 #include <ndevd.h>
@@ -35,6 +37,7 @@
 #endif
 
 struct udev_enumerate;
+struct udev_filter_head;
 
 #if defined (HAVE_LINUX_INPUT_H) || defined (HAVE_DEV_EVDEV_INPUT_H)
 create_node_handler_t	create_evdev_handler;
@@ -55,9 +58,7 @@ create_node_handler_t	create_hidraw_handler;
 #endif
 
 int udev_dev_enumerate(struct udev_enumerate *ue);
-#if defined(__OpenBSD__)
-int udev_fido_enumerate(struct udev_enumerate *ue);
-#endif
+uint64_t udev_dev_stamp(struct udev_filter_head *ufh);
 #if defined(__FreeBSD__) || defined(__DragonFly__)
 int udev_dev_monitor(char *msg, char *syspath, size_t syspathlen);
 #elif defined(__NetBSD__)
@@ -29,7 +29,11 @@
 #include <sys/sysmacros.h>
 #endif
 
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,27 +42,91 @@
 
 #include "udev-global.h"
 
+/*
+ * Initial arena space allocated along with the device itself. It is enough
+ * to hold list entries of typical input device so the whole device goes
+ * with a single allocation.
+ */
+#define	UDEV_DEVICE_ARENA_SIZE	512
+
+/*
+ * Cleared by benchmarks to allocate list entries one by one with malloc(3)
+ * as it was done before the arena, so both can be compared.
+ */
+bool _udev_device_arena_lists = true;
+
+/* Device number is not looked up yet */
+#define	UD_DEVNUM_UNKNOWN	((dev_t)-1)
+
+/* Create handler state, see udev_device_probe() */
+enum {
+	UD_PROBE_PENDING,
+	UD_PROBE_RUNNING,
+	UD_PROBE_DONE,
+};
+
+/*
+ * Devices are immutable once constructed: create handler output is
+ * published by udev_device_probe() and the cached device number is set
+ * atomically, so a device may be shared and read by several threads
+ * without locking. udev_device_set_sysattr_value() is the exception, it
+ * takes the device out of the context cache, so later lookups get a fresh
+ * one, and must not race with readers of the same handle. Each
+ * device holds a reference on its parent, which is published once when
+ * first requested.
+ */
 struct udev_device {
-	int refcount;
+	atomic_int refcount;
+	atomic_int probe;
+	_Atomic(dev_t) devnum;
 	struct {
 		unsigned int action : 2;
-		unsigned int parent_ref : 1;
+		unsigned int synthetic : 1;	/* parent made up by handler */
 	} flags;
 	struct udev_list prop_list;
 	struct udev_list sysattr_list;
 	struct udev_list tag_list;
 	struct udev_list devlink_list;
 	struct udev *udev;
-	struct udev_device *parent;
+	_Atomic(struct udev_device *) parent;
+	struct udev_device_parent_spec *parent_spec;
+	struct arena arena;
 	char syspath[];
 };
 
+/*
+ * Synthetic parent declared by create handler. Parent device is built on
+ * the first request and shared with siblings which declared the same one.
+ */
+struct udev_device_parent_spec {
+	struct udev_list props;
+	struct udev_list sysattrs;
+	char sysname[];
+};
+
+/* Returns device shared through context cache, building it on miss */
+static struct udev_device *
+udev_device_new_cached(struct udev *udev, const char *syspath)
+{
+	struct udev_device *ud;
+
+	ud = _udev_device_cache_get(udev, syspath);
+	if (ud != NULL)
+		return (ud);
+
+	ud = udev_device_new_common(udev, syspath, UD_ACTION_NONE);
+	if (ud != NULL)
+		_udev_device_cache_put(udev, ud);
+
+	return (ud);
+}
+
 LIBUDEV_EXPORT struct udev_device *
 udev_device_new_from_syspath(struct udev *udev, const char *syspath)
 {
 
 	TRC("(%s)", syspath);
-	return (udev_device_new_common(udev, syspath, UD_ACTION_NONE));
+	return (udev_device_new_cached(udev, syspath));
 }
 
 LIBUDEV_EXPORT struct udev_device *
@@ -66,14 +134,19 @@ udev_device_new_from_devnum(struct udev *udev, char type, dev_t devnum)
 {
 	const char *syspath;
 	struct udev_device *device;
+	dev_t unknown = UD_DEVNUM_UNKNOWN;
 
 	syspath = get_syspath_by_devnum(devnum);
 	TRC("(%d) -> %s", (int)devnum, syspath != NULL ? syspath : "not found");
 	if (syspath == NULL)
 		return (NULL);
 
-	device = udev_device_new_common(udev, syspath, UD_ACTION_NONE);
+	device = udev_device_new_cached(udev, syspath);
 	free((void *)syspath);
+	/* Index lookup has just verified the number, save a stat() */
+	if (device != NULL)
+		atomic_compare_exchange_strong(&device->devnum, &unknown,
+		    devnum);
 
 	return (device);
 }
@@ -82,17 +155,93 @@ LIBUDEV_EXPORT struct udev_device *
 udev_device_new_from_subsystem_sysname(struct udev *udev,
    const char *subsystem, const char *sysname)
 {
+	char syspath[DEV_PATH_MAX];
 
 	TRC("(%s, %s)", subsystem, sysname);
-	UNIMPL();
-	return (NULL);
+	if (udev == NULL || subsystem == NULL || sysname == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	if (get_syspath_by_subsystem_sysname(subsystem, sysname, syspath,
+	    sizeof(syspath)) == NULL) {
+		errno = ENOENT;
+		return (NULL);
+	}
+
+	return (udev_device_new_cached(udev, syspath));
 }
 
+/*
+ * Parses decimal number of device id. Unlike sscanf() does not take
+ * leading blanks or sign. Returns pointer past the number or NULL.
+ */
+static const char *
+udev_device_id_number(const char *s, unsigned int *val)
+{
+	unsigned long ul;
+	char *end;
+
+	if (*s < '0' || *s > '9')
+		return (NULL);
+	errno = 0;
+	ul = strtoul(s, &end, 10);
+	if (errno != 0 || ul > UINT_MAX)
+		return (NULL);
+
+	*val = ul;
+	return (end);
+}
+
+/*
+ * Device ids are "c<major>:<minor>" for character devices, "n<ifindex>"
+ * for network interfaces and "+<subsystem>:<sysname>" for the rest. All
+ * of them are resolved without scanning.
+ */
 LIBUDEV_EXPORT struct udev_device *
 udev_device_new_from_device_id(struct udev *udev, const char *id)
 {
+	char syspath[DEV_PATH_MAX], subsystem[DEV_PATH_MAX];
+	const char *sep;
+	unsigned int maj, min, ifindex;
+
 	TRC("(%s)", id);
-	UNIMPL();
+	if (udev == NULL || id == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	switch (id[0]) {
+	case 'c':
+		if ((sep = udev_device_id_number(id + 1, &maj)) == NULL ||
+		    *sep != ':' ||
+		    (sep = udev_device_id_number(sep + 1, &min)) == NULL ||
+		    *sep != '\0')
+			break;
+		return (udev_device_new_from_devnum(udev, 'c',
+		    makedev(maj, min)));
+	case 'n':
+		if ((sep = udev_device_id_number(id + 1, &ifindex)) == NULL ||
+		    *sep != '\0')
+			break;
+		if (udev_net_lookup_index(ifindex, syspath,
+		    sizeof(syspath)) == NULL) {
+			errno = ENOENT;
+			return (NULL);
+		}
+		return (udev_device_new_cached(udev, syspath));
+	case '+':
+		/* Sysname may contain colons itself, e.g. PCI dbsf */
+		sep = strchr(id + 1, ':');
+		if (sep == NULL || sep == id + 1 ||
+		    (size_t)(sep - id) > sizeof(subsystem))
+			break;
+		strlcpy(subsystem, id + 1, sep - id);
+		return (udev_device_new_from_subsystem_sysname(udev,
+		    subsystem, sep + 1));
+	}
+
+	errno = EINVAL;
 	return (NULL);
 }
 
@@ -134,6 +283,7 @@ udev_device_get_properties_list_entry(struct udev_device *ud)
 {
 
 	TRC("(%p(%s))", ud, ud->syspath);
+	udev_device_probe(ud);
 	return (udev_list_entry_get_first(udev_device_get_properties_list(ud)));
 }
 
@@ -150,6 +300,7 @@ udev_device_get_sysattr_list_entry(struct udev_device *ud)
 
 
 	TRC("(%p(%s))", ud, ud->syspath);
+	udev_device_probe(ud);
 	return (udev_list_entry_get_first(udev_device_get_sysattr_list(ud)));
 }
 
@@ -165,6 +316,7 @@ udev_device_get_tags_list_entry(struct udev_device *ud)
 {
 
 	TRC("(%p(%s))", ud, ud->syspath);
+	udev_device_probe(ud);
 	return (udev_list_entry_get_first(udev_device_get_tags_list(ud)));
 }
 
@@ -181,6 +333,7 @@ udev_device_has_tag(struct udev_device *ud, const char *tag)
 	struct udev_list_entry *ule;
 
 	TRC("(%p, %s)", ud, tag);
+	udev_device_probe(ud);
 	ule = udev_list_entry_get_first(udev_device_get_tags_list(ud));
 	return (udev_list_entry_get_by_name(ule, tag) != NULL);
 }
@@ -203,61 +356,47 @@ udev_device_get_devlinks_list_entry(struct udev_device *ud)
 {
 
 	TRC("(%p(%s))", ud, ud->syspath);
+	udev_device_probe(ud);
 	return (udev_list_entry_get_first(udev_device_get_devlinks_list(ud)));
 }
 
 LIBUDEV_EXPORT char const *
 udev_device_get_property_value(struct udev_device *ud, char const *property)
 {
-	char const *key, *value;
+	char const *value = NULL;
 	struct udev_list_entry *entry;
 
-	udev_list_entry_foreach(entry, udev_list_entry_get_first(&ud->prop_list)) {
-		key = _udev_list_entry_get_name(entry);
-		if (!key)
-			continue;
-		if (strcmp(key, property) == 0) {
-			value = _udev_list_entry_get_value(entry);
-			TRC("(%p(%s), %s) %s", ud, ud->syspath, property, value);
-			return (value);
-		}
-	}
-	TRC("(%p(%s), %s) NULL", ud, ud->syspath, property);
-	return (NULL);
+	udev_device_probe(ud);
+	entry = udev_list_find(&ud->prop_list, property);
+	if (entry != NULL)
+		value = _udev_list_entry_get_value(entry);
+	TRC("(%p(%s), %s) %s", ud, ud->syspath, property, value);
+	return (value);
 }
 
 LIBUDEV_EXPORT char const *
 udev_device_get_sysattr_value(struct udev_device *ud, const char *sysattr)
 {
-	char const *key, *value;
+	char const *value = NULL;
 	struct udev_list_entry *entry;
 
-	udev_list_entry_foreach(entry, udev_list_entry_get_first(&ud->sysattr_list)) {
-		key = _udev_list_entry_get_name(entry);
-		if (!key)
-			continue;
-		if (strcmp(key, sysattr) == 0) {
-			value = _udev_list_entry_get_value(entry);
-			TRC("(%p(%s), %s) %s", ud, ud->syspath, sysattr, value);
-			return (value);
-		}
-	}
-	TRC("(%p(%s), %s) NULL", ud, ud->syspath, sysattr);
-	return (NULL);
+	udev_device_probe(ud);
+	entry = udev_list_find(&ud->sysattr_list, sysattr);
+	if (entry != NULL)
+		value = _udev_list_entry_get_value(entry);
+	TRC("(%p(%s), %s) %s", ud, ud->syspath, sysattr, value);
+	return (value);
 }
 
 LIBUDEV_EXPORT int
 udev_device_set_sysattr_value(struct udev_device *ud, const char *sysattr, const char *value)
 {
-	struct udev_list_entry *entry;
 
-	udev_list_entry_foreach(entry, udev_list_entry_get_first(&ud->sysattr_list)) {
-		char const *key;
-
-		key = _udev_list_entry_get_name(entry);
-		if (key && strcmp(key, sysattr) == 0)
-			return -1;
-	}
+	udev_device_probe(ud);
+	/* Devices looked up from now on must not see the change */
+	_udev_device_cache_evict(ud->udev, ud);
+	if (udev_list_find(&ud->sysattr_list, sysattr) != NULL)
+		return -1;
 
 	return udev_list_insert(&ud->sysattr_list, sysattr, value);
 }
@@ -270,28 +409,110 @@ udev_device_get_udev(struct udev_device *ud)
 	return (ud->udev);
 }
 
+/*
+ * Device lists are not expected to change after the create handler has
+ * run, so turn them into compact sorted arrays, along with the parent
+ * declared by the handler, and mark the device probed.
+ */
+static void
+udev_device_freeze(struct udev_device *ud)
+{
+
+	udev_list_freeze(&ud->prop_list);
+	udev_list_freeze(&ud->sysattr_list);
+	udev_list_freeze(&ud->tag_list);
+	udev_list_freeze(&ud->devlink_list);
+	if (ud->parent_spec != NULL) {
+		udev_list_freeze(&ud->parent_spec->props);
+		udev_list_freeze(&ud->parent_spec->sysattrs);
+	}
+	atomic_store_explicit(&ud->probe, UD_PROBE_DONE, memory_order_release);
+}
+
+/*
+ * Callers waiting for another thread to finish probing. Handlers may
+ * block on ioctls for a while, so the waiters sleep rather than spin.
+ * Concurrent probes of the same device are rare, one condition variable
+ * serves all devices.
+ */
+static pthread_mutex_t udev_device_probe_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t udev_device_probe_cv = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Run create handler on first access to device metadata or parent.
+ * Devices may be shared through the context cache, so the first caller
+ * probes and concurrent ones wait for it to finish.
+ */
+void
+udev_device_probe(struct udev_device *ud)
+{
+	int state = UD_PROBE_PENDING;
+
+	if (atomic_load_explicit(&ud->probe, memory_order_acquire) ==
+	    UD_PROBE_DONE)
+		return;
+
+	if (atomic_compare_exchange_strong(&ud->probe, &state,
+	    UD_PROBE_RUNNING)) {
+		TRC("(%p) %s", ud, ud->syspath);
+		_udev_stat_inc(ud->udev, UDEV_STAT_DEVICE_PROBES);
+		invoke_create_handler(ud);
+		udev_device_freeze(ud);
+		/* Waiters check the state under the mutex, none is missed */
+		pthread_mutex_lock(&udev_device_probe_mtx);
+		pthread_cond_broadcast(&udev_device_probe_cv);
+		pthread_mutex_unlock(&udev_device_probe_mtx);
+		return;
+	}
+
+	pthread_mutex_lock(&udev_device_probe_mtx);
+	while (atomic_load_explicit(&ud->probe, memory_order_acquire) !=
+	    UD_PROBE_DONE)
+		pthread_cond_wait(&udev_device_probe_cv,
+		    &udev_device_probe_mtx);
+	pthread_mutex_unlock(&udev_device_probe_mtx);
+}
+
+/* Checks if device metadata is there without running create handler */
+bool
+_udev_device_probed(struct udev_device *ud)
+{
+
+	return (atomic_load_explicit(&ud->probe, memory_order_acquire) ==
+	    UD_PROBE_DONE);
+}
+
 struct udev_device *
 udev_device_new_common(struct udev *udev, const char *syspath, int action)
 {
 	struct udev_device *ud;
+	struct arena *arena;
+	size_t syspathlen;
 
-	ud = calloc
-	    (1, offsetof(struct udev_device, syspath) + strlen(syspath) + 1);
+	syspathlen = strlen(syspath) + 1;
+	ud = calloc(1, offsetof(struct udev_device, syspath) + syspathlen +
+	    UDEV_DEVICE_ARENA_SIZE);
 	if (ud == NULL)
 		return (NULL);
 
 	_udev_ref(udev);
 	ud->udev = udev;
 	ud->flags.action = action;
-	ud->parent = NULL;
-	ud->refcount = 1;
-	strcpy(ud->syspath, syspath);
-	udev_list_init(&ud->prop_list);
-	udev_list_init(&ud->sysattr_list);
-	udev_list_init(&ud->tag_list);
-	udev_list_init(&ud->devlink_list);
-	if (action != UD_ACTION_REMOVE)
-		invoke_create_handler(ud);
+	atomic_init(&ud->parent, NULL);
+	ud->parent_spec = NULL;
+	atomic_init(&ud->refcount, 1);
+	memcpy(ud->syspath, syspath, syspathlen);
+	arena_init(&ud->arena, ud->syspath + syspathlen, UDEV_DEVICE_ARENA_SIZE);
+	arena = _udev_device_arena_lists ? &ud->arena : NULL;
+	udev_list_init_arena(&ud->prop_list, arena);
+	udev_list_init_arena(&ud->sysattr_list, arena);
+	udev_list_init_arena(&ud->tag_list, arena);
+	udev_list_init_arena(&ud->devlink_list, arena);
+	atomic_init(&ud->devnum, UD_DEVNUM_UNKNOWN);
+	/* Removed devices are gone, there is nothing to probe */
+	atomic_init(&ud->probe, UD_PROBE_PENDING);
+	if (action == UD_ACTION_REMOVE)
+		udev_device_freeze(ud);
 
 	return (ud);
 }
@@ -330,7 +551,8 @@ udev_device_get_subsystem(struct udev_device *ud)
 {
 	const char *subsystem;
 
-	subsystem = get_subsystem_by_syspath(ud->syspath, NULL);
+	subsystem = ud->flags.synthetic ? UNKNOWN_SUBSYSTEM :
+	    get_subsystem_by_syspath(ud->syspath, NULL);
 	TRC("(%p(%s)) %s", ud, ud->syspath, subsystem);
 	return (subsystem);
 }
@@ -340,20 +562,45 @@ udev_device_ref(struct udev_device *ud)
 {
 	TRC("(%p/%s) %d", ud, ud->syspath, ud->refcount);
 
-	++ud->refcount;
+	atomic_fetch_add_explicit(&ud->refcount, 1, memory_order_relaxed);
 	return (ud);
 }
 
+/* References device unless it is already being released */
+bool
+_udev_device_tryref(struct udev_device *ud)
+{
+	int refcount;
+
+	refcount = atomic_load_explicit(&ud->refcount, memory_order_relaxed);
+	do {
+		if (refcount == 0)
+			return (false);
+	} while (!atomic_compare_exchange_weak_explicit(&ud->refcount,
+	    &refcount, refcount + 1, memory_order_relaxed,
+	    memory_order_relaxed));
+
+	return (true);
+}
+
 static void
 udev_device_free(struct udev_device *ud)
 {
+	struct udev_device *parent;
 
+	/* Entries of arena backed lists are released altogether with it */
 	udev_list_free(&ud->prop_list);
 	udev_list_free(&ud->sysattr_list);
 	udev_list_free(&ud->tag_list);
 	udev_list_free(&ud->devlink_list);
-	if (!ud->flags.parent_ref && ud->parent != NULL)
-		udev_device_free(ud->parent);
+	if (ud->parent_spec != NULL) {
+		udev_list_free(&ud->parent_spec->props);
+		udev_list_free(&ud->parent_spec->sysattrs);
+	}
+	arena_free(&ud->arena);
+	parent = atomic_load_explicit(&ud->parent, memory_order_acquire);
+	if (parent != NULL)
+		udev_device_unref(parent);
 	_udev_unref(ud->udev);
 	free(ud);
 }
@@ -362,18 +609,131 @@ LIBUDEV_EXPORT struct udev_device *
 udev_device_unref(struct udev_device *ud)
 {
 	TRC("(%p/%s) %d", ud, ud->syspath, ud->refcount);
-	if (--ud->refcount == 0)
+	if (atomic_fetch_sub_explicit(&ud->refcount, 1,
+	    memory_order_acq_rel) == 1) {
+		if (ud->flags.synthetic)
+			_udev_parent_forget(ud->udev, ud);
 		udev_device_free(ud);
+	}
 	return (NULL);
 }
 
+/*
+ * Declares synthetic parent of device being probed. Handler fills its
+ * lists, the device itself is built only if somebody asks for it.
+ */
+int
+udev_device_set_parent_sysname(struct udev_device *ud, const char *sysname)
+{
+	struct udev_device_parent_spec *ps;
+	size_t len;
+
+	len = strlen(sysname) + 1;
+	ps = arena_alloc(&ud->arena,
+	    offsetof(struct udev_device_parent_spec, sysname) + len);
+	if (ps == NULL)
+		return (-1);
+
+	udev_list_init_arena(&ps->props, ud->prop_list.arena);
+	udev_list_init_arena(&ps->sysattrs, ud->prop_list.arena);
+	memcpy(ps->sysname, sysname, len);
+	ud->parent_spec = ps;
+
+	return (0);
+}
+
+struct udev_list *
+udev_device_get_parent_properties_list(struct udev_device *ud)
+{
+
+	return (&ud->parent_spec->props);
+}
+
+struct udev_list *
+udev_device_get_parent_sysattr_list(struct udev_device *ud)
+{
+
+	return (&ud->parent_spec->sysattrs);
+}
+
+/*
+ * Returns parent declared by @p ud with a new reference, reusing one
+ * built for a sibling if it has the same contents. Parent lists share
+ * template entries of the declaration. Synthetic parents are not matched
+ * against subsystems table.
+ */
+static struct udev_device *
+udev_device_new_parent(struct udev_device *ud)
+{
+	struct udev_device_parent_spec *ps = ud->parent_spec;
+	struct udev_device *parent;
+	uint32_t content;
+
+	content = udev_list_digest(&ps->sysattrs,
+	    udev_list_digest(&ps->props, 2166136261u));
+	parent = _udev_parent_get(ud->udev, ps->sysname, content);
+	if (parent != NULL) {
+		if (udev_list_equal(&parent->prop_list, &ps->props) &&
+		    udev_list_equal(&parent->sysattr_list, &ps->sysattrs))
+			return (parent);
+		udev_device_unref(parent);
+	}
+
+	parent = udev_device_new_common(ud->udev, ps->sysname,
+	    UD_ACTION_NONE);
+	if (parent == NULL)
+		return (NULL);
+
+	parent->flags.synthetic = 1;
+	udev_list_inherit(&parent->prop_list, &ps->props);
+	udev_list_inherit(&parent->sysattr_list, &ps->sysattrs);
+	udev_device_freeze(parent);
+	_udev_parent_put(ud->udev, parent, content);
+
+	return (parent);
+}
+
+struct udev_device *
+_udev_device_get_parent(struct udev_device *ud)
+{
+	struct udev_device *parent, *expected = NULL;
+
+	udev_device_probe(ud);
+	parent = atomic_load_explicit(&ud->parent, memory_order_acquire);
+	if (parent != NULL || ud->parent_spec == NULL)
+		return (parent);
+
+	parent = udev_device_new_parent(ud);
+	if (parent != NULL && !atomic_compare_exchange_strong(&ud->parent,
+	    &expected, parent)) {
+		/* Another thread has published the parent first */
+		udev_device_unref(parent);
+		parent = expected;
+	}
+
+	return (parent);
+}
+
+/*
+ * Returns syspath of the parent declared by create handler or NULL, without
+ * building the parent device. Declared parents have no parents themselves.
+ */
+const char *
+_udev_device_get_parent_syspath(struct udev_device *ud)
+{
+
+	udev_device_probe(ud);
+	return (ud->parent_spec != NULL ? ud->parent_spec->sysname : NULL);
+}
+
 LIBUDEV_EXPORT struct udev_device *
 udev_device_get_parent(struct udev_device *ud)
 {
-	TRC("(%p/%s) %p", ud, ud->syspath, ud->parent);
-	if (ud->parent != NULL)
-		ud->flags.parent_ref = 1;
-	return (ud->parent);
+	struct udev_device *parent;
+
+	parent = _udev_device_get_parent(ud);
+	TRC("(%p/%s) %p", ud, ud->syspath, parent);
+	return (parent);
 }
 
 LIBUDEV_EXPORT struct udev_device *
@@ -381,7 +741,7 @@ udev_device_get_parent_with_subsystem_devtype(struct udev_device *ud,
     const char *subsystem, const char *devtype)
 {
 	const char *parent_subsystem, *parent_devtype = NULL;
-	struct udev_device *parent, *child;
+	struct udev_device *parent;
 
 	TRC("(%p/%s, %s, %s)", ud, ud->syspath, subsystem, devtype);
 	if (ud == NULL || subsystem == NULL) {
@@ -389,9 +749,11 @@ udev_device_get_parent_with_subsystem_devtype(struct udev_device *ud,
 		return (NULL);
 	}
 
-	for (parent = ud->parent, child = ud;
+	for (parent = _udev_device_get_parent(ud);
 	     parent != NULL;
-	     child = parent, parent = parent->parent) {
+	     parent = _udev_device_get_parent(parent)) {
+		if (parent->flags.synthetic)
+			continue;
 		parent_subsystem = get_subsystem_by_syspath(parent->syspath,
 		    &parent_devtype);
 		if (parent_subsystem == NULL ||
@@ -399,21 +761,13 @@ udev_device_get_parent_with_subsystem_devtype(struct udev_device *ud,
 			continue;
 		if (devtype == NULL ||
 		    (parent_devtype != NULL &&
-		     strcmp(parent_devtype, devtype) == 0)) {
-			child->flags.parent_ref = 1;
+		     strcmp(parent_devtype, devtype) == 0))
 			return (parent);
-		}
 	}
 	errno = ENOENT;
 	return (NULL);
 }
 
-void
-udev_device_set_parent(struct udev_device *ud, struct udev_device *parent)
-{
-	ud->parent = parent;
-}
-
 LIBUDEV_EXPORT int
 udev_device_get_is_initialized(struct udev_device *ud)
 {
@@ -452,15 +806,25 @@ udev_device_get_devnum(struct udev_device *ud)
 {
 	const char *devpath;
 	struct stat st;
+	dev_t devnum;
 
 	TRC("(%p) %s", ud, ud->syspath);
+	devnum = atomic_load_explicit(&ud->devnum, memory_order_relaxed);
+	if (devnum != UD_DEVNUM_UNKNOWN)
+		return (devnum);
+
 	devpath = get_devpath_by_syspath(ud->syspath);
 	if (devpath == NULL ||
-	    stat(devpath, &st) < 0 ||
+	    dev_stat(devpath, &st) < 0 ||
 	    !S_ISCHR(st.st_mode))
-		return (makedev(0, 0));
+		devnum = makedev(0, 0);
+	else {
+		devnum = st.ST_RDEV;
+		devnum_index_insert(devnum, ud->syspath);
+	}
+	atomic_store_explicit(&ud->devnum, devnum, memory_order_relaxed);
 
-	return (st.ST_RDEV);
+	return (devnum);
 }
 
 LIBUDEV_EXPORT const char *
@@ -469,6 +833,8 @@ udev_device_get_devtype(struct udev_device *ud)
 	const char *devtype;
 
 	TRC("(%p) %s", ud, ud->syspath);
+	if (ud->flags.synthetic)
+		return (UNKNOWN_DEVTYPE);
 	(void)get_subsystem_by_syspath(ud->syspath, &devtype);
 	return (devtype);
 }
@@ -37,14 +37,25 @@ enum {
 	UD_ACTION_HOTPLUG,
 };
 
+extern bool _udev_device_arena_lists;
+
 struct udev_device *udev_device_new_common(struct udev *udev,
     const char *syspath, int action);
+void udev_device_probe(struct udev_device *ud);
+bool _udev_device_probed(struct udev_device *ud);
 struct udev_list *udev_device_get_properties_list(struct udev_device *ud);
 struct udev_list *udev_device_get_sysattr_list(struct udev_device *ud);
 struct udev_list *udev_device_get_tags_list(struct udev_device *ud);
 struct udev_list *udev_device_get_devlinks_list(struct udev_device *ud);
-void udev_device_set_parent(struct udev_device *ud, struct udev_device *parent);
+int udev_device_set_parent_sysname(struct udev_device *ud,
+    const char *sysname);
+struct udev_list *udev_device_get_parent_properties_list(
+    struct udev_device *ud);
+struct udev_list *udev_device_get_parent_sysattr_list(struct udev_device *ud);
 const char *_udev_device_get_syspath(struct udev_device *ud);
 const char *_udev_device_get_sysname(struct udev_device *ud);
+struct udev_device *_udev_device_get_parent(struct udev_device *ud);
+const char *_udev_device_get_parent_syspath(struct udev_device *ud);
+bool _udev_device_tryref(struct udev_device *ud);
 
 #endif /* UDEV_DVICE_H_ */
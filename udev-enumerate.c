@@ -24,6 +24,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/queue.h>
 #include <sys/stat.h>
 
 #include <errno.h>
@@ -36,33 +37,83 @@
 #include <fcntl.h>
 #endif
 #include <pthread.h>
-pthread_mutex_t scan_mtx = PTHREAD_MUTEX_INITIALIZER;
-
+#include <stdatomic.h>
 
 #include "udev-global.h"
 
+#if defined(__OpenBSD__)
+/*
+ * Enumeration opens devices to check that they are usable, do not let it
+ * interfere with /dev scan of monitor polling thread.
+ */
+pthread_mutex_t scan_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct udev_enumerate_pool;
+
 struct udev_enumerate {
-	int refcount;
+	atomic_int refcount;
+	int nthreads;
+	struct udev_enumerate_pool *pool;	/* non-NULL while scanning */
 	struct udev_filter_head filters;
 	struct udev_list dev_list;
+	struct udev_list added_list;	/* changes found by last rescan */
+	struct udev_list removed_list;
+	udev_enumerate_cb_t cb;		/* non-NULL while streaming */
+	void *cb_arg;
+	atomic_bool cb_stop;		/* callback asked to stop the scan */
 	struct udev *udev;
 };
 
+/*
+ * State of parallel scan. Worker threads run device sources and match
+ * syspaths reported by them against filters. Enumeration list is kept
+ * sorted, so resulting order does not depend on threads scheduling.
+ */
+struct udev_enumerate_job {
+	STAILQ_ENTRY(udev_enumerate_job) next;
+	int source;		/* index in sources table or -1 */
+	char syspath[];
+};
+
+struct udev_enumerate_pool {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	STAILQ_HEAD(, udev_enumerate_job) jobs;
+	unsigned int busy;	/* number of jobs being run */
+	int ret;
+};
+
+#define	UDEV_ENUMERATE_THREADS_MAX	16
+
+/* Does not reference @p udev */
+static void
+udev_enumerate_init(struct udev_enumerate *ue, struct udev *udev)
+{
+
+	memset(ue, 0, sizeof(*ue));
+	ue->udev = udev;
+	atomic_init(&ue->refcount, 1);
+	ue->nthreads = 1;
+	ue->pool = NULL;
+	udev_filter_init(&ue->filters);
+	udev_list_init(&ue->dev_list);
+	udev_list_init(&ue->added_list);
+	udev_list_init(&ue->removed_list);
+}
+
 LIBUDEV_EXPORT struct udev_enumerate *
 udev_enumerate_new(struct udev *udev)
 {
 	struct udev_enumerate *ue;
 
 	TRC();
-	ue = calloc(1, sizeof(struct udev_enumerate));
+	ue = malloc(sizeof(struct udev_enumerate));
 	if (ue == NULL)
 		return (NULL);
 
-	ue->udev = udev;
+	udev_enumerate_init(ue, udev);
 	udev_ref(udev);
-	ue->refcount = 1;
-	udev_filter_init(&ue->filters);
-	udev_list_init(&ue->dev_list);
 
 	return (ue);
 }
@@ -72,7 +123,7 @@ udev_enumerate_ref(struct udev_enumerate *ue)
 {
 
 	TRC("(%p) refcount=%d", ue, ue->refcount);
-	++ue->refcount;
+	atomic_fetch_add_explicit(&ue->refcount, 1, memory_order_relaxed);
 	return (ue);
 }
 
@@ -81,9 +132,12 @@ udev_enumerate_unref(struct udev_enumerate *ue)
 {
 
 	TRC("(%p) refcount=%d", ue, ue->refcount);
-	if (--ue->refcount == 0) {
+	if (atomic_fetch_sub_explicit(&ue->refcount, 1,
+	    memory_order_acq_rel) == 1) {
 		udev_filter_free(&ue->filters);
 		udev_list_free(&ue->dev_list);
+		udev_list_free(&ue->added_list);
+		udev_list_free(&ue->removed_list);
 		udev_unref(ue->udev);
 		free(ue);
 	}
@@ -163,9 +217,15 @@ LIBUDEV_EXPORT int
 udev_enumerate_add_match_parent(struct udev_enumerate *ue,
     struct udev_device *parent)
 {
+
 	TRC("(%p, %p)", ue, parent);
-	UNIMPL();
-	return (0);
+	if (parent == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	return (udev_filter_add(&ue->filters, UDEV_FILTER_TYPE_PARENT, 0,
+	    _udev_device_get_syspath(parent), NULL));
 }
 LIBUDEV_EXPORT int
 udev_enumerate_add_match_is_initialized(struct udev_enumerate *ue)
@@ -176,20 +236,51 @@ udev_enumerate_add_match_is_initialized(struct udev_enumerate *ue)
 	return (0);
 }
 
-int
-udev_enumerate_add_device(struct udev_enumerate *ue, const char *syspath)
+struct udev_filter_head *
+udev_enumerate_get_filters(struct udev_enumerate *ue)
+{
+
+	return (&ue->filters);
+}
+
+static int
+udev_enumerate_match_device(struct udev_enumerate *ue, const char *syspath)
 {
+	struct udev_device *ud;
 	int ret = 0;
 #if defined(__OpenBSD__)
 	int devfd = -1;
 #endif
 
-	if (udev_filter_match(ue->udev, &ue->filters, syspath) &&
+	/* Unwind the scan once streaming callback has asked to stop */
+	if (atomic_load_explicit(&ue->cb_stop, memory_order_relaxed))
+		return (-1);
+
+	if (udev_filter_match(ue->udev, &ue->filters, syspath, UD_ACTION_NONE,
+	    &ud)
 #if defined(__OpenBSD__)
-	    ((devfd = open(syspath, O_RDWR)) != -1) &&
+	    && ((devfd = dev_open(syspath, O_RDWR)) != -1)
 #endif
-	    udev_list_insert(&ue->dev_list, syspath, NULL) == -1)
-		ret = -1;
+	    ) {
+		/* Device probed by filters is likely to be asked for next */
+		if (ud != NULL)
+			_udev_device_cache_put(ue->udev, ud);
+		if (ue->pool != NULL)
+			pthread_mutex_lock(&ue->pool->mtx);
+		if (ue->cb == NULL)
+			ret = udev_list_insert(&ue->dev_list, syspath, NULL);
+		else if (atomic_load_explicit(&ue->cb_stop,
+		    memory_order_relaxed) ||
+		    ue->cb(ue, syspath, ue->cb_arg) != 0) {
+			atomic_store_explicit(&ue->cb_stop, true,
+			    memory_order_relaxed);
+			ret = -1;
+		}
+		if (ue->pool != NULL)
+			pthread_mutex_unlock(&ue->pool->mtx);
+	}
+	if (ud != NULL)
+		udev_device_unref(ud);
 
 #if defined(__OpenBSD__)
 	if (devfd != -1)
@@ -198,42 +289,548 @@ udev_enumerate_add_device(struct udev_enumerate *ue, const char *syspath)
 	return (ret);
 }
 
+static int
+udev_enumerate_queue_job(struct udev_enumerate_pool *pool, int source,
+    const char *syspath)
+{
+	struct udev_enumerate_job *job;
+	size_t len;
+
+	len = syspath == NULL ? 0 : strlen(syspath) + 1;
+	job = malloc(sizeof(*job) + len);
+	if (job == NULL)
+		return (-1);
+
+	job->source = source;
+	if (syspath != NULL)
+		memcpy(job->syspath, syspath, len);
+	pthread_mutex_lock(&pool->mtx);
+	STAILQ_INSERT_TAIL(&pool->jobs, job, next);
+	pthread_cond_signal(&pool->cv);
+	pthread_mutex_unlock(&pool->mtx);
+	return (0);
+}
+
+/* Called by device sources for every device found */
+int
+udev_enumerate_add_device(struct udev_enumerate *ue, const char *syspath)
+{
+
+	/* Make the source stop walking once streaming callback asked to */
+	if (atomic_load_explicit(&ue->cb_stop, memory_order_relaxed))
+		return (-1);
+
+	/* Defer filter matching, it may involve device probing */
+	if (ue->pool != NULL)
+		return (udev_enumerate_queue_job(ue->pool, -1, syspath));
+
+	return (udev_enumerate_match_device(ue, syspath));
+}
+
+/*
+ * Adds devices collected by a source which could not do it in place,
+ * e.g. while holding a lock.
+ */
+int
+udev_enumerate_add_devices(struct udev_enumerate *ue, struct udev_list *ul)
+{
+	struct udev_list_entry *ule;
+
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(ul))
+		if (udev_enumerate_add_device(ue,
+		    _udev_list_entry_get_name(ule)) == -1)
+			return (-1);
+
+	return (0);
+}
+
+/*
+ * Device sources and syspath prefixes of devices they produce. A source is
+ * not scanned if none of its subsystems can pass the subsystem filters.
+ * Sources with .stamp function can tell whether their devices may have
+ * changed without a monitor running. Only devices of sources marked with
+ * .parents are given parents by their create handlers.
+ */
+static const struct {
+	const char *prefix;
+	int (*enumerate)(struct udev_enumerate *ue);
+	uint64_t (*stamp)(struct udev_filter_head *ufh);
+	bool parents;
+} udev_enumerate_sources[] = {
+	{ DEV_PATH_ROOT "/",	udev_dev_enumerate,	udev_dev_stamp,	true },
+	{ "/sys/",		udev_sys_enumerate,	NULL,		false },
+	{ "/pci/",		udev_pci_enumerate,	NULL,		false },
+	{ "/net/",		udev_net_enumerate,	NULL,		false },
+};
+
+static bool
+udev_enumerate_source_needed(struct udev_enumerate *ue, size_t i)
+{
+
+	if (syspath_prefix_match_subsystem(udev_enumerate_sources[i].prefix,
+	    &ue->filters))
+		return (true);
+
+	TRC("(%p) skip %s", ue, udev_enumerate_sources[i].prefix);
+	return (false);
+}
+
+static void *
+udev_enumerate_worker(void *arg)
+{
+	struct udev_enumerate *ue = arg;
+	struct udev_enumerate_pool *pool = ue->pool;
+	struct udev_enumerate_job *job;
+	int ret;
+
+	pthread_mutex_lock(&pool->mtx);
+	for (;;) {
+		/* Busy workers may still queue new jobs */
+		while ((job = STAILQ_FIRST(&pool->jobs)) == NULL &&
+		    pool->busy != 0)
+			pthread_cond_wait(&pool->cv, &pool->mtx);
+		if (job == NULL)
+			break;
+
+		STAILQ_REMOVE_HEAD(&pool->jobs, next);
+		pool->busy++;
+		pthread_mutex_unlock(&pool->mtx);
+
+		/* Jobs left once streaming callback asked to stop are dropped */
+		if (atomic_load_explicit(&ue->cb_stop, memory_order_relaxed))
+			ret = -1;
+		else if (job->source >= 0)
+			ret = udev_enumerate_sources[job->source].enumerate(ue);
+		else
+			ret = udev_enumerate_match_device(ue, job->syspath);
+		free(job);
+
+		pthread_mutex_lock(&pool->mtx);
+		pool->busy--;
+		if (ret == -1)
+			pool->ret = -1;
+		if (pool->busy == 0 && STAILQ_EMPTY(&pool->jobs))
+			pthread_cond_broadcast(&pool->cv);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+
+	return (NULL);
+}
+
+static int
+udev_enumerate_scan_parallel(struct udev_enumerate *ue, const bool *needed)
+{
+	struct udev_enumerate_pool pool;
+	struct udev_enumerate_job *job;
+	pthread_t threads[UDEV_ENUMERATE_THREADS_MAX];
+	size_t i;
+	int nthreads = 0, ret = 0;
+
+	pthread_mutex_init(&pool.mtx, NULL);
+	pthread_cond_init(&pool.cv, NULL);
+	STAILQ_INIT(&pool.jobs);
+	pool.busy = 0;
+	pool.ret = 0;
+
+	for (i = 0; i < nitems(udev_enumerate_sources) && ret == 0; i++)
+		if (needed[i])
+			ret = udev_enumerate_queue_job(&pool, i, NULL);
+
+	if (ret == 0) {
+		ue->pool = &pool;
+		/* Calling thread is a worker too */
+		while (nthreads < ue->nthreads - 1 &&
+		    pthread_create(&threads[nthreads], NULL,
+		    udev_enumerate_worker, ue) == 0)
+			nthreads++;
+		udev_enumerate_worker(ue);
+		while (nthreads > 0)
+			pthread_join(threads[--nthreads], NULL);
+		ue->pool = NULL;
+		ret = pool.ret;
+	}
+
+	/* Leftovers of failed queueing */
+	while ((job = STAILQ_FIRST(&pool.jobs)) != NULL) {
+		STAILQ_REMOVE_HEAD(&pool.jobs, next);
+		free(job);
+	}
+	pthread_cond_destroy(&pool.cv);
+	pthread_mutex_destroy(&pool.mtx);
+
+	return (ret);
+}
+
+/*
+ * Returns combined stamp of needed sources or 0 if some of them can not
+ * be checked for changes.
+ */
+static uint64_t
+udev_enumerate_stamp(struct udev_filter_head *ufh, const bool *needed)
+{
+	uint64_t stamp = 1, source_stamp;
+	size_t i;
+
+	for (i = 0; i < nitems(udev_enumerate_sources); i++) {
+		if (!needed[i])
+			continue;
+		if (udev_enumerate_sources[i].stamp == NULL)
+			return (0);
+		source_stamp = udev_enumerate_sources[i].stamp(ufh);
+		if (source_stamp == 0)
+			return (0);
+		stamp = stamp * 31 + source_stamp;
+	}
+
+	return (stamp != 0 ? stamp : 1);
+}
+
+static int
+udev_enumerate_scan_sources(struct udev_enumerate *ue, const bool *needed)
+{
+	size_t i;
+	int ret = 0;
+
+	if (ue->nthreads > 1)
+		return (udev_enumerate_scan_parallel(ue, needed));
+
+	for (i = 0; i < nitems(udev_enumerate_sources) && ret == 0; i++)
+		if (needed[i])
+			ret = udev_enumerate_sources[i].enumerate(ue);
+
+	return (ret);
+}
+
+/*
+ * Builds parent to children links of all devices which may have parents.
+ * Parents are only known from create handlers, so devices not in the
+ * device cache are probed, but parent devices are not built. The result
+ * is kept in the context. The internal scan does not reference the
+ * context, so it does not hold off the cache flush of udev_unref().
+ */
+static int
+udev_enumerate_build_links(struct udev_enumerate *ue, const bool *sources,
+    struct udev_list *links)
+{
+	struct udev_enumerate all;
+	struct udev_list_entry *ule;
+	struct udev_device *ud;
+	const char *syspath, *parent;
+	char *link;
+	size_t i;
+	int ret = 0;
+
+	udev_enumerate_init(&all, ue->udev);
+	for (i = 0; i < nitems(udev_enumerate_sources) && ret == 0; i++)
+		if (sources[i])
+			ret = udev_enumerate_sources[i].enumerate(&all);
+
+	for (ule = udev_list_entry_get_first(&all.dev_list);
+	     ule != NULL && ret == 0;
+	     ule = udev_list_entry_get_next(ule)) {
+		syspath = _udev_list_entry_get_name(ule);
+		ud = _udev_device_cache_get(ue->udev, syspath);
+		if (ud == NULL)
+			ud = udev_device_new_common(ue->udev, syspath,
+			    UD_ACTION_NONE);
+		if (ud == NULL) {
+			ret = -1;
+			break;
+		}
+		parent = _udev_device_get_parent_syspath(ud);
+		if (parent != NULL) {
+			link = malloc(strlen(parent) + strlen(syspath) + 2);
+			if (link == NULL)
+				ret = -1;
+			else {
+				sprintf(link, "%s\n%s", parent, syspath);
+				ret = udev_list_insert(links, link, NULL);
+				free(link);
+			}
+		}
+		udev_device_unref(ud);
+	}
+
+	udev_filter_free(&all.filters);
+	udev_list_free(&all.dev_list);
+	return (ret);
+}
+
+/*
+ * Matches only the devices requested with parent filters and their
+ * descendants taken from the parent index. Returns 1 if there are no
+ * parent filters or the index can not be used, so the sources have to be
+ * scanned as usual.
+ */
+static int
+udev_enumerate_scan_children(struct udev_enumerate *ue,
+    unsigned int generation)
+{
+	bool sources[nitems(udev_enumerate_sources)];
+	struct udev_filter_head none;
+	struct udev_list parents, candidates, links;
+	uint64_t stamp = 0;
+	size_t i;
+	int ret;
+
+	udev_list_init(&parents);
+	udev_list_init(&candidates);
+	udev_list_init(&links);
+	ret = udev_filter_get_exprs(&ue->filters, UDEV_FILTER_TYPE_PARENT,
+	    &parents);
+	if (ret == 0 && udev_list_entry_get_first(&parents) == NULL)
+		ret = 1;
+
+	for (i = 0; i < nitems(udev_enumerate_sources); i++)
+		sources[i] = udev_enumerate_sources[i].parents;
+	udev_filter_init(&none);
+	if (ret == 0 && !_udev_watched(ue->udev) &&
+	    (stamp = udev_enumerate_stamp(&none, sources)) == 0)
+		ret = 1;
+
+	if (ret == 0 && _udev_children_lookup(ue->udev, generation, stamp,
+	    &parents, &candidates) != 0) {
+		TRC("(%p) rebuild parent index", ue);
+		udev_list_free(&candidates);
+		ret = udev_enumerate_build_links(ue, sources, &links);
+		if (ret == 0)
+			_udev_children_store(ue->udev, generation, stamp,
+			    &links);
+		/* Index may have been replaced by concurrent scan */
+		if (ret == 0 && _udev_children_lookup(ue->udev, generation,
+		    stamp, &parents, &candidates) != 0)
+			ret = 1;
+	}
+
+	if (ret == 0)
+		ret = udev_enumerate_add_devices(ue, &candidates);
+	udev_list_free(&parents);
+	udev_list_free(&candidates);
+	udev_list_free(&links);
+
+	return (ret);
+}
+
 LIBUDEV_EXPORT int
 udev_enumerate_scan_devices(struct udev_enumerate *ue)
 {
-	int ret;
+	bool needed[nitems(udev_enumerate_sources)];
+	unsigned int generation;
+	uint64_t stamp = 0;
+	char *key;
+	size_t i;
+	int ret = 0;
 
 	TRC("(%p)", ue);
 
+#if defined(__OpenBSD__)
 	pthread_mutex_lock(&scan_mtx);
+#endif
 
 	udev_list_free(&ue->dev_list);
 
-	ret = udev_dev_enumerate(ue);
-	if (ret == 0)
-		ret = udev_sys_enumerate(ue);
-	if (ret == 0)
-		ret = udev_pci_enumerate(ue);
-	if (ret == 0)
-		ret = udev_net_enumerate(ue);
-#if defined(__OpenBSD__)
-	if (ret == 0)
-		ret = udev_fido_enumerate(ue);
-#endif
+	/* Take generation first, events during the scan make result stale */
+	generation = _udev_generation(ue->udev);
+	for (i = 0; i < nitems(udev_enumerate_sources); i++)
+		needed[i] = udev_enumerate_source_needed(ue, i);
+
+	/* Without monitor running results are checked with source stamps */
+	key = udev_filter_key(&ue->filters);
+	if (key != NULL && !_udev_watched(ue->udev) &&
+	    (stamp = udev_enumerate_stamp(&ue->filters, needed)) == 0) {
+		free(key);
+		key = NULL;
+	}
+
+	if (key != NULL && _udev_scan_cache_lookup(ue->udev, key, generation,
+	    stamp, &ue->dev_list) == 0) {
+		TRC("(%p) cache hit", ue);
+		goto out;
+	}
+	udev_list_free(&ue->dev_list);
+
+	ret = udev_enumerate_scan_children(ue, generation);
+	if (ret == 1)
+		ret = udev_enumerate_scan_sources(ue, needed);
 	if (ret == -1)
 		udev_list_free(&ue->dev_list);
+	else if (key != NULL)
+		_udev_scan_cache_store(ue->udev, key, generation, stamp,
+		    &ue->dev_list);
 
+out:
+	free(key);
+#if defined(__OpenBSD__)
 	pthread_mutex_unlock(&scan_mtx);
+#endif
 	
 	return ret;
 }
 
+/*
+ * Calls @p cb for every matching device as soon as it is found, instead
+ * of collecting the devices to the enumeration list. Devices come in
+ * discovery order. The scan stops as soon as @p cb returns non-zero.
+ * In parallel mode callback invocations are serialized, and sources and
+ * queued devices are abandoned by all workers once @p cb asked to stop.
+ */
+LIBUDEV_EXPORT int
+udev_enumerate_scan_devices_cb(struct udev_enumerate *ue,
+    udev_enumerate_cb_t cb, void *arg)
+{
+	bool needed[nitems(udev_enumerate_sources)];
+	size_t i;
+	int ret;
+
+	TRC("(%p, %p)", ue, cb);
+	if (cb == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+#if defined(__OpenBSD__)
+	pthread_mutex_lock(&scan_mtx);
+#endif
+
+	udev_list_free(&ue->dev_list);
+	for (i = 0; i < nitems(udev_enumerate_sources); i++)
+		needed[i] = udev_enumerate_source_needed(ue, i);
+
+	ue->cb = cb;
+	ue->cb_arg = arg;
+	ret = udev_enumerate_scan_children(ue, _udev_generation(ue->udev));
+	if (ret == 1)
+		ret = udev_enumerate_scan_sources(ue, needed);
+	if (atomic_exchange_explicit(&ue->cb_stop, false,
+	    memory_order_relaxed))
+		ret = 0;
+	ue->cb = NULL;
+
+#if defined(__OpenBSD__)
+	pthread_mutex_unlock(&scan_mtx);
+#endif
+
+	return (ret);
+}
+
+/*
+ * Sets number of threads used by udev_enumerate_scan_devices() to run
+ * device sources and probe devices concurrently. 1 means serial scan.
+ */
+LIBUDEV_EXPORT int
+udev_enumerate_set_parallel(struct udev_enumerate *ue, int nthreads)
+{
+
+	TRC("(%p, %d)", ue, nthreads);
+	if (nthreads < 1) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (nthreads > UDEV_ENUMERATE_THREADS_MAX)
+		nthreads = UDEV_ENUMERATE_THREADS_MAX;
+	ue->nthreads = nthreads;
+	return (0);
+}
+
+/*
+ * Repeats the scan and records syspaths which appeared or disappeared
+ * since the previous one. Both scan results are sorted, so the difference
+ * is found with a single merge pass.
+ */
+LIBUDEV_EXPORT int
+udev_enumerate_rescan_devices(struct udev_enumerate *ue)
+{
+	struct udev_list prev;
+	struct udev_list_entry *ule_old, *ule_new;
+	int cmp, ret;
+
+	TRC("(%p)", ue);
+
+	udev_list_free(&ue->added_list);
+	udev_list_free(&ue->removed_list);
+	udev_list_init(&prev);
+	udev_list_swap(&prev, &ue->dev_list);
+
+	if (udev_enumerate_scan_devices(ue) == -1) {
+		udev_list_swap(&prev, &ue->dev_list);
+		udev_list_free(&prev);
+		return (-1);
+	}
+
+	ret = 0;
+	ule_old = udev_list_entry_get_first(&prev);
+	ule_new = udev_list_entry_get_first(&ue->dev_list);
+	while (ret == 0 && (ule_old != NULL || ule_new != NULL)) {
+		if (ule_old == NULL)
+			cmp = 1;
+		else if (ule_new == NULL)
+			cmp = -1;
+		else
+			cmp = strcmp(_udev_list_entry_get_name(ule_old),
+			    _udev_list_entry_get_name(ule_new));
+
+		if (cmp < 0)
+			ret = udev_list_insert(&ue->removed_list,
+			    _udev_list_entry_get_name(ule_old), NULL);
+		else if (cmp > 0)
+			ret = udev_list_insert(&ue->added_list,
+			    _udev_list_entry_get_name(ule_new), NULL);
+		if (cmp <= 0)
+			ule_old = udev_list_entry_get_next(ule_old);
+		if (cmp >= 0)
+			ule_new = udev_list_entry_get_next(ule_new);
+	}
+	udev_list_free(&prev);
+
+	if (ret == -1) {
+		udev_list_free(&ue->added_list);
+		udev_list_free(&ue->removed_list);
+	}
+	return (ret);
+}
+
+LIBUDEV_EXPORT struct udev_list_entry *
+udev_enumerate_get_added_list_entry(struct udev_enumerate *ue)
+{
+
+	TRC("(%p)", ue);
+	return (udev_list_entry_get_first(&ue->added_list));
+}
+
+LIBUDEV_EXPORT struct udev_list_entry *
+udev_enumerate_get_removed_list_entry(struct udev_enumerate *ue)
+{
+
+	TRC("(%p)", ue);
+	return (udev_list_entry_get_first(&ue->removed_list));
+}
+
+/*
+ * Subsystems are reported as /sys/bus/<name> entries of "subsystem"
+ * subsystem. Their set is known at compile time, so only filters are run.
+ */
 LIBUDEV_EXPORT int
 udev_enumerate_scan_subsystems(struct udev_enumerate *ue)
 {
+	char syspath[SYS_PATH_MAX];
+	const char *const *names;
+	size_t i, count;
 
 	TRC("(%p)", ue);
-	UNIMPL();
+
+	udev_list_free(&ue->dev_list);
+	names = get_subsystem_names(&count);
+	for (i = 0; i < count; i++) {
+		snprintf(syspath, sizeof(syspath), "/sys/bus/%s", names[i]);
+		if (udev_filter_match(ue->udev, &ue->filters, syspath,
+		    UD_ACTION_NONE, NULL) &&
+		    udev_list_insert(&ue->dev_list, syspath, NULL) == -1) {
+			udev_list_free(&ue->dev_list);
+			return (-1);
+		}
+	}
+
 	return (0);
 }
 
@@ -27,7 +27,11 @@
 #define UDEV_ENUMERATE_H_
 
 struct udev_enumerate;
+struct udev_filter_head;
+struct udev_list;
 
 int udev_enumerate_add_device(struct udev_enumerate *ue, const char *syspath);
+int udev_enumerate_add_devices(struct udev_enumerate *ue, struct udev_list *ul);
+struct udev_filter_head *udev_enumerate_get_filters(struct udev_enumerate *ue);
 
 #endif /* UDEV_ENUMERATE_H_ */
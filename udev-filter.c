@@ -27,7 +27,6 @@
 #include <sys/queue.h>
 
 #include <assert.h>
-#include <fnmatch.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -40,10 +39,26 @@ struct udev_filter_entry {
 	int type;
 	int neg;
 	STAILQ_ENTRY(udev_filter_entry) next;
+	const char *atom;	/* interned expr if it is well-known name */
+	struct fnpattern expr_fnp;
+	struct fnpattern value_fnp;
 	char *value;
 	char expr[];
 };
 
+/*
+ * Filter types are numbered in order of evaluation cost. Negative filters
+ * of a type are checked before positive ones.
+ */
+#define	UDEV_FILTER_NEEDS_DEVICE(type)	((type) >= UDEV_FILTER_TYPE_PROPERTY)
+
+static inline int
+udev_filter_rank(struct udev_filter_entry *ufe)
+{
+
+	return (ufe->type * 2 + (ufe->neg == 0));
+}
+
 void
 udev_filter_init(struct udev_filter_head *ufh)
 {
@@ -55,7 +70,7 @@ int
 udev_filter_add(struct udev_filter_head *ufh, int type, int neg,
     const char *expr, const char *value)
 {
-	struct udev_filter_entry *ufe;
+	struct udev_filter_entry *ufe, *ufe1, *prev = NULL;
 	size_t exprlen, valuelen;
 
 	assert(type >= 0 && type < UDEV_FILTER_TYPE_CNT);
@@ -70,12 +85,42 @@ udev_filter_add(struct udev_filter_head *ufh, int type, int neg,
 	ufe->type = type;
 	ufe->neg = neg;
 	strcpy(ufe->expr, expr);
+	fnpattern_compile(&ufe->expr_fnp, ufe->expr);
+	ufe->atom = NULL;
+	if (ufe->expr_fnp.type == FNPATTERN_LITERAL)
+		ufe->atom = udev_list_atom(expr);
 	ufe->value = NULL;
 	if (value != NULL) {
 		ufe->value = ufe->expr + exprlen;
 		strcpy(ufe->value, value);
+		fnpattern_compile(&ufe->value_fnp, ufe->value);
+	}
+
+	/* Keep list sorted by rank, preserving order of equal entries */
+	STAILQ_FOREACH(ufe1, ufh, next) {
+		if (udev_filter_rank(ufe1) > udev_filter_rank(ufe))
+			break;
+		prev = ufe1;
 	}
-	STAILQ_INSERT_TAIL(ufh, ufe, next);
+	if (prev == NULL)
+		STAILQ_INSERT_HEAD(ufh, ufe, next);
+	else
+		STAILQ_INSERT_AFTER(ufh, prev, ufe, next);
+	return (0);
+}
+
+/* Collects expressions of positive filters of given @p type into @p ul */
+int
+udev_filter_get_exprs(struct udev_filter_head *ufh, int type,
+    struct udev_list *ul)
+{
+	struct udev_filter_entry *ufe;
+
+	STAILQ_FOREACH(ufe, ufh, next)
+		if (ufe->type == type && ufe->neg == 0 &&
+		    udev_list_insert(ul, ufe->expr, NULL) == -1)
+			return (-1);
+
 	return (0);
 }
 
@@ -93,40 +138,158 @@ udev_filter_free(struct udev_filter_head *ufh)
 	STAILQ_INIT(ufh);
 }
 
+static int
+udev_filter_entry_cmp(const void *p1, const void *p2)
+{
+	struct udev_filter_entry *ufe1 = *(struct udev_filter_entry **)p1;
+	struct udev_filter_entry *ufe2 = *(struct udev_filter_entry **)p2;
+	int ret;
+
+	ret = udev_filter_rank(ufe1) - udev_filter_rank(ufe2);
+	if (ret == 0)
+		ret = strcmp(ufe1->expr, ufe2->expr);
+	if (ret == 0 && ufe1->value != ufe2->value)
+		ret = ufe1->value == NULL ? -1 : ufe2->value == NULL ? 1 :
+		    strcmp(ufe1->value, ufe2->value);
+
+	return (ret);
+}
+
+/*
+ * Returns malloc'ed string identifying the set of filters, regardless of
+ * order and duplicates they were added with, or NULL on failure.
+ */
+char *
+udev_filter_key(struct udev_filter_head *ufh)
+{
+	struct udev_filter_entry *ufe, **sorted;
+	size_t n = 0, len = 1, i;
+	char *key, *p;
+
+	STAILQ_FOREACH(ufe, ufh, next) {
+		n++;
+		len += strlen(ufe->expr) + 4 +
+		    (ufe->value != NULL ? strlen(ufe->value) + 1 : 0);
+	}
+
+	sorted = calloc(n + 1, sizeof(*sorted));
+	key = malloc(len);
+	if (sorted == NULL || key == NULL) {
+		free(sorted);
+		free(key);
+		return (NULL);
+	}
+
+	n = 0;
+	STAILQ_FOREACH(ufe, ufh, next)
+		sorted[n++] = ufe;
+	qsort(sorted, n, sizeof(*sorted), udev_filter_entry_cmp);
+
+	p = key;
+	for (i = 0; i < n; i++) {
+		if (i > 0 && udev_filter_entry_cmp(&sorted[i - 1],
+		    &sorted[i]) == 0)
+			continue;
+		/* Fields are separated with ASCII unit/record separators */
+		p += sprintf(p, "%c%s", 'A' + udev_filter_rank(sorted[i]),
+		    sorted[i]->expr);
+		if (sorted[i]->value != NULL)
+			p += sprintf(p, "\x1f%s", sorted[i]->value);
+		*p++ = '\x1e';
+	}
+	*p = '\0';
+
+	free(sorted);
+	return (key);
+}
+
 static bool
 fnmatch_list(struct udev_list *list, struct udev_filter_entry *ufe)
 {
 	struct udev_list_entry *entry;
 	const char *key, *value;
 
+	if (ufe->expr_fnp.type == FNPATTERN_LITERAL) {
+		entry = udev_list_find(list, ufe->atom != NULL ?
+		    ufe->atom : ufe->expr);
+		if (entry == NULL)
+			return (false);
+		value = _udev_list_entry_get_value(entry);
+		return (ufe->value == NULL ? value == NULL :
+		    value != NULL && fnpattern_match(&ufe->value_fnp, value));
+	}
+
 	udev_list_entry_foreach(entry, udev_list_entry_get_first(list)) {
 		key = _udev_list_entry_get_name(entry);
-		if (fnmatch(ufe->expr, key, 0) == 0) {
+		if (fnpattern_match(&ufe->expr_fnp, key)) {
 			value = _udev_list_entry_get_value(entry);
 			if (ufe->value == NULL && value == NULL)
 				return (true);
 			if (ufe->value != NULL && value != NULL &&
-			    fnmatch(ufe->value, value, 0) == 0)
+			    fnpattern_match(&ufe->value_fnp, value))
 				return (true);
 		}
 	}
 	return (false);
 }
 
+static bool
+udev_filter_entry_match(struct udev_filter_entry *ufe, struct udev_device *ud,
+    const char *subsystem, const char *devtype, const char *sysname)
+{
+
+	switch (ufe->type) {
+	case UDEV_FILTER_TYPE_SUBSYSTEM:
+		/* Negative subsystem filters ignore devtype */
+		return (fnpattern_match(&ufe->expr_fnp, subsystem) &&
+		    (ufe->neg != 0 || ufe->value == NULL ||
+		    (devtype != NULL &&
+		     fnpattern_match(&ufe->value_fnp, devtype))));
+	case UDEV_FILTER_TYPE_SYSNAME:
+		return (fnpattern_match(&ufe->expr_fnp, sysname));
+	case UDEV_FILTER_TYPE_PROPERTY:
+		return (ud != NULL &&
+		    fnmatch_list(udev_device_get_properties_list(ud), ufe));
+	case UDEV_FILTER_TYPE_TAG:
+		return (ud != NULL &&
+		    fnmatch_list(udev_device_get_tags_list(ud), ufe));
+	case UDEV_FILTER_TYPE_SYSATTR:
+		return (ud != NULL &&
+		    fnmatch_list(udev_device_get_sysattr_list(ud), ufe));
+	case UDEV_FILTER_TYPE_PARENT:
+		/* The parent device itself matches too */
+		for (; ud != NULL; ud = _udev_device_get_parent(ud))
+			if (strcmp(_udev_device_get_syspath(ud),
+			    ufe->expr) == 0)
+				return (true);
+		return (false);
+	default:
+		return (false);
+	}
+}
+
+/*
+ * Filters are kept sorted by group (see udev_filter_rank()), so groups
+ * checked against syspath only are evaluated first and the device is
+ * built only if it has passed all of them. Positive filters of a group
+ * are OR'ed, groups are AND'ed, any matching negative filter rejects.
+ * Device built for a match is returned in @p udp, if that is not NULL,
+ * so the caller does not have to probe it again. Removed devices can not
+ * be probed, they are matched as last seen by the device cache, or pass
+ * filters needing device if they are not there.
+ */
 bool
 udev_filter_match(struct udev *udev, struct udev_filter_head *ufh,
-    const char *syspath)
+    const char *syspath, int action, struct udev_device **udp)
 {
 	struct udev_filter_entry *ufe;
 	struct udev_device *ud = NULL;
 	const char *subsystem, *devtype, *sysname;
-	struct {
-		bool	seen;
-		bool	matched;
-	} score[UDEV_FILTER_TYPE_CNT], *i;
-	bool ret = false;
+	bool matched = true, ret = false, unknown = false;
+	int rank = -1;
 
-	memset(score, 0, sizeof(score));
+	if (udp != NULL)
+		*udp = NULL;
 	subsystem = get_subsystem_by_syspath(syspath, &devtype);
 	if (strcmp(subsystem, UNKNOWN_SUBSYSTEM) == 0)
 		return (0);
@@ -134,128 +297,88 @@ udev_filter_match(struct udev *udev, struct udev_filter_head *ufh,
 	sysname = get_sysname_by_syspath(syspath);
 
 	STAILQ_FOREACH(ufe, ufh, next) {
-		if (ufe->neg != 0)
+		if (udev_filter_rank(ufe) != rank) {
+			/* No positive filter of previous group matched */
+			if (!matched)
+				goto out;
+			rank = udev_filter_rank(ufe);
+			matched = ufe->neg != 0;
+		} else if (matched && ufe->neg == 0)
 			continue;
-		score[ufe->type].seen = true;
-		switch (ufe->type) {
-		case UDEV_FILTER_TYPE_SUBSYSTEM:
-			if (fnmatch(ufe->expr, subsystem, 0) == 0 &&
-			    (ufe->value == NULL ||
-			    (ufe->value != NULL && devtype != NULL &&
-			     fnmatch(ufe->value, devtype, 0) == 0)))
-				score[ufe->type].matched = true;
-			break;
-		case UDEV_FILTER_TYPE_SYSNAME:
-			if (fnmatch(ufe->expr, sysname, 0) == 0)
-				score[ufe->type].matched = true;
-			break;
-		case UDEV_FILTER_TYPE_PROPERTY:
-			if (ud == NULL)
-				ud = udev_device_new_common(udev, syspath,
-				    UD_ACTION_NONE);
-			if (ud == NULL)
-				break;
-			if (fnmatch_list(
-			    udev_device_get_properties_list(ud), ufe))
-				score[ufe->type].matched = true;
-			break;
-		case UDEV_FILTER_TYPE_TAG:
-			if (ud == NULL)
-				ud = udev_device_new_common(udev, syspath,
-				    UD_ACTION_NONE);
-			if (ud == NULL)
-				break;
-			if (fnmatch_list(
-			    udev_device_get_tags_list(ud), ufe))
-				score[ufe->type].matched = true;
-			break;
-		case UDEV_FILTER_TYPE_SYSATTR:
-			if (ud == NULL)
+
+		if (UDEV_FILTER_NEEDS_DEVICE(ufe->type) && ud == NULL &&
+		    !unknown) {
+			if (action == UD_ACTION_REMOVE) {
+				/* Never probed one would be probed too late */
+				ud = _udev_device_cache_last(udev, syspath);
+				if (ud != NULL && !_udev_device_probed(ud)) {
+					udev_device_unref(ud);
+					ud = NULL;
+				}
+				unknown = ud == NULL;
+			} else {
 				ud = udev_device_new_common(udev, syspath,
-				    UD_ACTION_NONE);
-			if (ud == NULL)
-				break;
-			if (fnmatch_list(
-			    udev_device_get_sysattr_list(ud), ufe))
-				score[ufe->type].matched = true;
-			break;
-		default:
-			;
+				    action);
+				if (ud != NULL)
+					udev_device_probe(ud);
+				_udev_stat_inc(udev, UDEV_STAT_FILTER_PROBES);
+			}
 		}
-	}
-
-	for (i = score; i < score + UDEV_FILTER_TYPE_CNT; i++)
-		if (i->seen != i->matched)
-			goto out;
-
-	ret = true;
-	STAILQ_FOREACH(ufe, ufh, next) {
-		if (ufe->neg != 1)
+		if (unknown && UDEV_FILTER_NEEDS_DEVICE(ufe->type)) {
+			if (ufe->neg == 0)
+				matched = true;
 			continue;
-		switch (ufe->type) {
-		case UDEV_FILTER_TYPE_SUBSYSTEM:
-			if (fnmatch(ufe->expr, subsystem, 0) == 0) {
-				ret = false;
-				goto out;
-			}
-			break;
-		case UDEV_FILTER_TYPE_SYSATTR:
-			if (ud == NULL)
-				ud = udev_device_new_common(udev, syspath,
-				    UD_ACTION_NONE);
-			if (ud == NULL)
-				break;
-			if (fnmatch_list(
-			    udev_device_get_sysattr_list(ud), ufe)) {
-				ret = false;
+		}
+
+		if (udev_filter_entry_match(ufe, ud, subsystem, devtype,
+		    sysname)) {
+			if (ufe->neg != 0)
 				goto out;
-			}
-			break;
-		default:
-			;
+			matched = true;
 		}
 	}
 
+	ret = matched;
 out:
-	if (ud != NULL)
+	/* Removal is reported with a device of its own */
+	if (ud != NULL && ret && udp != NULL && action != UD_ACTION_REMOVE)
+		*udp = ud;
+	else if (ud != NULL)
 		udev_device_unref(ud);
+	else if (!ret) {
+		/* Count rejects made before building device needed later */
+		while (ufe != NULL && !UDEV_FILTER_NEEDS_DEVICE(ufe->type))
+			ufe = STAILQ_NEXT(ufe, next);
+		if (ufe != NULL)
+			_udev_stat_inc(udev, UDEV_STAT_FILTER_PROBES_AVOIDED);
+	}
 
 	return (ret);
 }
 
 /*
- * Returns true if the given @p subsystem is accepted by the
- * filters applied to the enumerator @p ue.
+ * Returns true if the given @p subsystem is accepted by the subsystem
+ * filters in @p ufh. Other filter types are not taken into account.
  */
 bool
 udev_filter_match_subsystem(struct udev_filter_head *ufh, const char *subsystem)
 {
-	if (!subsystem)
-		return false;
-
-	if (STAILQ_EMPTY(ufh))
-		return true;
-
 	struct udev_filter_entry *ufe;
+	bool seen = false;
 
-	/* Scan for negative matches */
-	STAILQ_FOREACH(ufe, ufh, next) {
-		if (ufe->type == UDEV_FILTER_TYPE_SUBSYSTEM &&
-			ufe->neg != 0 &&
-			fnmatch(ufe->expr, subsystem, 0) == 0) {
-			return false;
-		}
-	}
+	if (subsystem == NULL)
+		return (false);
 
-	/* Not empty, scan for positive matches */
+	/* Subsystem filters are at the head, negative ones go first */
 	STAILQ_FOREACH(ufe, ufh, next) {
-		if (ufe->type == UDEV_FILTER_TYPE_SUBSYSTEM &&
-			ufe->neg == 0 &&
-			fnmatch(ufe->expr, subsystem, 0) == 0) {
-			return true;
-		}
+		if (ufe->type != UDEV_FILTER_TYPE_SUBSYSTEM)
+			break;
+		if (fnpattern_match(&ufe->expr_fnp, subsystem))
+			return (ufe->neg == 0);
+		if (ufe->neg == 0)
+			seen = true;
 	}
 
-	/* Not empty, matched nothing */
-	return false;
+	/* No positive filters means any subsystem is accepted */
+	return (!seen);
 }
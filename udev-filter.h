@@ -30,12 +30,15 @@
 #include <sys/queue.h>
 #include <stdbool.h>
 
+struct udev_list;
+
 enum {
 	UDEV_FILTER_TYPE_SUBSYSTEM,
 	UDEV_FILTER_TYPE_SYSNAME,
 	UDEV_FILTER_TYPE_PROPERTY,
 	UDEV_FILTER_TYPE_TAG,
 	UDEV_FILTER_TYPE_SYSATTR,
+	UDEV_FILTER_TYPE_PARENT,
 	UDEV_FILTER_TYPE_CNT,
 };
 STAILQ_HEAD(udev_filter_head, udev_filter_entry);
@@ -44,9 +47,12 @@ void udev_filter_init(struct udev_filter_head *ufh);
 bool udev_filter_match_subsystem(struct udev_filter_head *ufh,
     const char *subsystem);
 bool udev_filter_match(struct udev *udev, struct udev_filter_head *ufh,
-    const char *syspath);
+    const char *syspath, int action, struct udev_device **udp);
 int udev_filter_add(struct udev_filter_head *ufh, int type, int neg,
     const char *expr, const char *value);
+int udev_filter_get_exprs(struct udev_filter_head *ufh, int type,
+    struct udev_list *ul);
 void udev_filter_free(struct udev_filter_head *ufh);
+char *udev_filter_key(struct udev_filter_head *ufh);
 
 #endif /* UDEV_FILTER_H_ */
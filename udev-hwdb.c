@@ -25,12 +25,13 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 
 #include "udev-global.h"
 
 struct udev_hwdb {
-	int refcount;
+	atomic_int refcount;
 };
 
 LIBUDEV_EXPORT struct udev_hwdb *
@@ -41,7 +42,7 @@ udev_hwdb_new(struct udev *udev)
 	TRC("(%p)", udev);
 	uh = calloc(1, sizeof(struct udev_hwdb));
 	if (uh != NULL)
-		uh->refcount = 1;
+		atomic_init(&uh->refcount, 1);
 	return (uh);
 }
 
@@ -50,7 +51,8 @@ udev_hwdb_ref(struct udev_hwdb *uh)
 {
 	TRC("(%p)", uh);
 	if (uh != NULL)
-		++uh->refcount;
+		atomic_fetch_add_explicit(&uh->refcount, 1,
+		    memory_order_relaxed);
         return (uh);
 }
 
@@ -58,7 +60,8 @@ LIBUDEV_EXPORT struct udev_hwdb *
 udev_hwdb_unref(struct udev_hwdb *uh)
 {
 	TRC("(%p)", uh);
-	if (uh != NULL && --uh->refcount == 0)
+	if (uh != NULL && atomic_fetch_sub_explicit(&uh->refcount, 1,
+	    memory_order_acq_rel) == 1)
 		free(uh);
 	return (NULL);
 }
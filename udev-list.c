@@ -25,58 +25,383 @@
 
 #include "udev-global.h"
 
+#include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 struct udev_list_entry {
 	struct udev_list *list;
-	RB_ENTRY(udev_list_entry) link;
+	const char *name;	/* atom or points to inline copy in data */
 	char *value;
-	char name[];
+	uint32_t hash;
+	bool atom;
 };
 
-static struct udev_list_entry *udev_list_entry_alloc(const char* name,
-    const char* value);
-static void udev_list_entry_free(struct udev_list_entry *ule);
+struct udev_list_node {
+	RB_ENTRY(udev_list_node) link;
+	struct udev_list_entry entry;
+	char data[];
+};
+
+#define	UDEV_LIST_NODE(ule)						\
+	((struct udev_list_node *)					\
+	    ((char *)(ule) - offsetof(struct udev_list_node, entry)))
+
+/*
+ * Well-known property and sysattr names. Entries with these names point
+ * to the table rather than carry own copy of the name. The table must be
+ * kept sorted so that comparison of atom pointers gives the same order
+ * as strcmp() of the names does.
+ */
+#define	UDEV_ATOM_LEN_MAX	24
+static const char udev_atoms[][UDEV_ATOM_LEN_MAX] = {
+	"HOTPLUG", "ID_INPUT", "ID_INPUT_ACCELEROMETER",
+	"ID_INPUT_JOYSTICK", "ID_INPUT_KEY", "ID_INPUT_KEYBOARD",
+	"ID_INPUT_MOUSE", "ID_INPUT_SWITCH", "ID_INPUT_TABLET",
+	"ID_INPUT_TOUCHPAD", "ID_INPUT_TOUCHSCREEN", "ID_PATH",
+	"ID_PATH_TAG", "ID_SECURITY_TOKEN", "IFINDEX", "INTERFACE",
+	"NAME", "PCI_CLASS", "PCI_ID", "PCI_SLOT_NAME",
+	"PCI_SUBSYS_ID", "PRODUCT", "addr_len", "address", "class",
+	"device", "id", "ifindex", "name", "numa_node", "revision",
+	"subsystem_device", "subsystem_vendor", "uevent", "vendor",
+};
 
-RB_PROTOTYPE(udev_list, udev_list_entry, link, udev_list_entry_cmp);
+#define	UDEV_ATOM_INDEX_SIZE	128	/* power of 2, > 2 * nitems(atoms) */
+static uint32_t udev_atom_hashes[nitems(udev_atoms)];
+static uint8_t udev_atom_index[UDEV_ATOM_INDEX_SIZE];	/* atom number + 1 */
+static pthread_once_t udev_atom_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Besides of RB-tree which keeps entries ordered for iteration every list
+ * maintains open addressing (linear probing) hash index of its entries to
+ * make keyed lookups O(1). The index is grown to keep load factor below
+ * 3/4 and is never shrunk.
+ *
+ * Lists of device are not modified after the device is created, so they
+ * get frozen: the tree is replaced with array of entries sorted by name,
+ * which is walked linearly. The hash index is rebuilt to point into the
+ * array, lists sharing a template use its index. Names and values stay
+ * where they were put in the device arena. The list goes back to the tree
+ * (thaws) on the next modification.
+ */
+#define	UDEV_LIST_INDEX_MIN	8
+
+static struct udev_list_entry *udev_list_entry_alloc(struct arena *arena,
+    const char *name, const char *value);
+static void udev_list_entry_free(struct udev_list *ul,
+    struct udev_list_entry *ule);
+static int udev_list_thaw(struct udev_list *ul);
+
+RB_PROTOTYPE(udev_list_tree, udev_list_node, link, udev_list_node_cmp);
 
 void
 udev_list_init(struct udev_list *ul)
 {
 
-	RB_INIT(ul);
+	udev_list_init_arena(ul, NULL);
 }
 
-int
-udev_list_insert(struct udev_list *ul, char const *name, char const *value)
+/*
+ * Entries of list initialized with non-NULL arena are carved from it and
+ * are never freed one by one. They go away together with the arena.
+ */
+void
+udev_list_init_arena(struct udev_list *ul, struct arena *arena)
 {
-	struct udev_list_entry *ule, *old_ule;
 
-	ule = udev_list_entry_alloc(name, value);
-	if (!ule)
+	RB_INIT(&ul->tree);
+	ul->arena = arena;
+	ul->index = NULL;
+	ul->index_size = 0;
+	ul->count = 0;
+	ul->frozen = NULL;
+}
+
+/* FNV-1a */
+static uint32_t
+udev_list_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name != '\0')
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+
+	return (hash);
+}
+
+static void
+udev_atom_init(void)
+{
+	unsigned int i, j, mask;
+
+	mask = UDEV_ATOM_INDEX_SIZE - 1;
+	for (i = 0; i < nitems(udev_atoms); i++) {
+		assert(i == 0 || strcmp(udev_atoms[i - 1], udev_atoms[i]) < 0);
+		udev_atom_hashes[i] = udev_list_hash(udev_atoms[i]);
+		for (j = udev_atom_hashes[i] & mask;
+		     udev_atom_index[j] != 0;
+		     j = (j + 1) & mask)
+			;
+		udev_atom_index[j] = i + 1;
+	}
+}
+
+static const char *
+udev_atom_find(const char *name, uint32_t hash)
+{
+	unsigned int i, mask, atom;
+
+	pthread_once(&udev_atom_once, udev_atom_init);
+	mask = UDEV_ATOM_INDEX_SIZE - 1;
+	for (i = hash & mask; (atom = udev_atom_index[i]) != 0;
+	     i = (i + 1) & mask)
+		if (udev_atom_hashes[atom - 1] == hash &&
+		    strcmp(udev_atoms[atom - 1], name) == 0)
+			return (udev_atoms[atom - 1]);
+
+	return (NULL);
+}
+
+/*
+ * Returns interned copy of well-known name or NULL if name is not one of
+ * them. Names of list entries can be compared with the atom by pointer.
+ */
+const char *
+udev_list_atom(const char *name)
+{
+
+	return (udev_atom_find(name, udev_list_hash(name)));
+}
+
+static int
+udev_list_entry_cmp(const struct udev_list_entry *le1,
+    const struct udev_list_entry *le2)
+{
+
+	/* Atoms table is sorted so pointers order matches names order */
+	if (le1->atom && le2->atom)
+		return ((le1->name > le2->name) - (le1->name < le2->name));
+
+	return (strcmp(le1->name, le2->name));
+}
+
+static int
+udev_list_node_cmp(struct udev_list_node *n1, struct udev_list_node *n2)
+{
+
+	return (udev_list_entry_cmp(&n1->entry, &n2->entry));
+}
+
+/*
+ * Returns index slot holding entry with given name or empty slot where
+ * such an entry should be placed.
+ */
+static struct udev_list_entry **
+udev_list_index_slot(struct udev_list *ul, const char *name, uint32_t hash)
+{
+	struct udev_list_entry *ule;
+	unsigned int i, mask;
+
+	mask = ul->index_size - 1;
+	for (i = hash & mask; (ule = ul->index[i]) != NULL; i = (i + 1) & mask)
+		if (ule->name == name ||
+		    (ule->hash == hash && strcmp(ule->name, name) == 0))
+			break;
+
+	return (&ul->index[i]);
+}
+
+static int
+udev_list_index_grow(struct udev_list *ul)
+{
+	struct udev_list_entry **index, **old_index, *ule;
+	unsigned int size, old_size, i;
+
+	old_index = ul->index;
+	old_size = ul->index_size;
+	size = old_size == 0 ? UDEV_LIST_INDEX_MIN : old_size * 2;
+	if (ul->arena != NULL) {
+		index = arena_alloc(ul->arena, size * sizeof(*index));
+		if (index != NULL)
+			memset(index, 0, size * sizeof(*index));
+	} else
+		index = calloc(size, sizeof(*index));
+	if (index == NULL)
 		return (-1);
 
-	ule->list = ul;
-	old_ule = RB_FIND(udev_list, ul, ule);
-	if (old_ule != NULL) {
-		RB_REMOVE(udev_list, ul, old_ule);
-		udev_list_entry_free(old_ule);
+	ul->index = index;
+	ul->index_size = size;
+	for (i = 0; i < old_size; i++)
+		if ((ule = old_index[i]) != NULL)
+			*udev_list_index_slot(ul, ule->name, ule->hash) = ule;
+
+	if (ul->arena == NULL)
+		free(old_index);
+	return (0);
+}
+
+#if defined(__OpenBSD__)
+/* Backward shift deletion keeps probe sequences free of holes */
+static void
+udev_list_index_remove(struct udev_list *ul, struct udev_list_entry **slot)
+{
+	unsigned int i, j, home, mask;
+
+	mask = ul->index_size - 1;
+	i = j = slot - ul->index;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (ul->index[j] == NULL)
+			break;
+		home = ul->index[j]->hash & mask;
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		ul->index[i] = ul->index[j];
+		i = j;
+	}
+	ul->index[i] = NULL;
+}
+#endif
+
+static int
+udev_list_insert_entry(struct udev_list *ul, struct udev_list_entry *ule)
+{
+	struct udev_list_entry **slot;
+
+	if ((ul->count + 1) * 4 > ul->index_size * 3 &&
+	    udev_list_index_grow(ul) == -1) {
+		udev_list_entry_free(ul, ule);
+		return (-1);
 	}
 
-	RB_INSERT(udev_list, ul, ule);
+	ule->list = ul;
+	slot = udev_list_index_slot(ul, ule->name, ule->hash);
+	if (*slot != NULL) {
+		RB_REMOVE(udev_list_tree, &ul->tree, UDEV_LIST_NODE(*slot));
+		udev_list_entry_free(ul, *slot);
+	} else
+		ul->count++;
+
+	*slot = ule;
+	RB_INSERT(udev_list_tree, &ul->tree, UDEV_LIST_NODE(ule));
 	return (0);
 }
 
+static struct udev_list_entry *
+udev_list_frozen_find(struct udev_list *ul, const char *name)
+{
+	struct udev_list_entry *ule;
+	unsigned int lo, hi, mid;
+	int cmp;
+
+	lo = 0;
+	hi = ul->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		ule = &ul->frozen[mid];
+		if (ule->name == name)
+			return (ule);
+		cmp = strcmp(ule->name, name);
+		if (cmp == 0)
+			return (ule);
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (NULL);
+}
+
+struct udev_list_entry *
+udev_list_find(struct udev_list *ul, const char *name)
+{
+
+	if (ul->count == 0)
+		return (NULL);
+
+	if (ul->index == NULL)
+		return (udev_list_frozen_find(ul, name));
+
+	return (*udev_list_index_slot(ul, name, udev_list_hash(name)));
+}
+
+/* Returns the first entry whose name is not less than @p name */
+struct udev_list_entry *
+udev_list_lower_bound(struct udev_list *ul, const char *name)
+{
+	struct udev_list_node *node, *found = NULL;
+	unsigned int lo, hi, mid;
+
+	if (ul->frozen != NULL) {
+		lo = 0;
+		hi = ul->count;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (strcmp(ul->frozen[mid].name, name) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return (lo < ul->count ? &ul->frozen[lo] : NULL);
+	}
+
+	node = RB_ROOT(&ul->tree);
+	while (node != NULL) {
+		if (strcmp(node->entry.name, name) < 0)
+			node = RB_RIGHT(node, link);
+		else {
+			found = node;
+			node = RB_LEFT(node, link);
+		}
+	}
+
+	return (found != NULL ? &found->entry : NULL);
+}
+
+int
+udev_list_insert(struct udev_list *ul, char const *name, char const *value)
+{
+	struct udev_list_entry *ule;
+
+	if (ul->frozen != NULL && udev_list_thaw(ul) == -1)
+		return (-1);
+
+	ule = udev_list_entry_alloc(ul->arena, name, value);
+	if (!ule)
+		return (-1);
+
+	return (udev_list_insert_entry(ul, ule));
+}
+
 int
 udev_list_insertf(struct udev_list *ul, char const *name, char const *fmt, ...)
 {
+	struct udev_list_entry *ule;
 	char *value = NULL;
 	va_list ap;
 	int ret = -1;
 
+	if (ul->frozen != NULL && udev_list_thaw(ul) == -1)
+		return (-1);
+
+	if (ul->arena != NULL) {
+		va_start(ap, fmt);
+		value = arena_vasprintf(ul->arena, fmt, ap);
+		va_end(ap);
+		if (value == NULL)
+			return (-1);
+		ule = udev_list_entry_alloc(ul->arena, name, NULL);
+		if (ule == NULL)
+			return (-1);
+		ule->value = value;
+		return (udev_list_insert_entry(ul, ule));
+	}
+
 	va_start(ap, fmt);
 	vasprintf(&value, fmt, ap);
 	va_end(ap);
@@ -93,108 +418,304 @@ udev_list_insertf(struct udev_list *ul, char const *name, char const *fmt, ...)
 int
 udev_list_member(struct udev_list *ul, char const *name, char const *value)
 {
-	struct udev_list_entry *ule;
-	size_t namelen, valuelen;
-	namelen = strlen(name) + 1;
-	valuelen = value == NULL ? 0 : strlen(value) + 1;
-	ule = calloc
-	    (1, offsetof(struct udev_list_entry, name) + namelen + valuelen);
-	if (!ule)
+
+	return (udev_list_find(ul, name) != NULL);
+}
+
+int
+udev_list_remove(struct udev_list *ul, char const *name, char const *value)
+{
+	struct udev_list_entry **slot, *old_ule;
+
+	if (ul->count == 0)
+		return (0);
+	if (ul->frozen != NULL && udev_list_thaw(ul) == -1)
 		return (-1);
-	ule->list = ul;
-	strcpy(ule->name, name);
-	ule->value = NULL;
-	if (value != NULL) {
-		ule->value = ule->name + namelen;
-		strcpy(ule->value, value);
-	}
-	if (RB_FIND(udev_list, ul, ule)) {
-		udev_list_entry_free(ule);
-		return (1);
+
+	slot = udev_list_index_slot(ul, name, udev_list_hash(name));
+	old_ule = *slot;
+	if (old_ule != NULL) {
+		udev_list_index_remove(ul, slot);
+		ul->count--;
+		RB_REMOVE(udev_list_tree, &ul->tree, UDEV_LIST_NODE(old_ule));
+		udev_list_entry_free(ul, old_ule);
 	}
 	return (0);
 }
+#endif
 
+/*
+ * Converts arena backed list to sorted array of entries. Tree nodes and
+ * the index are left to the arena.
+ */
 int
-udev_list_remove(struct udev_list *ul, char const *name, char const *value)
+udev_list_freeze(struct udev_list *ul)
 {
-	struct udev_list_entry *ule, *old_ule;
-	size_t namelen, valuelen;
-	namelen = strlen(name) + 1;
-	valuelen = value == NULL ? 0 : strlen(value) + 1;
-	ule = calloc
-	    (1, offsetof(struct udev_list_entry, name) + namelen + valuelen);
-	if (!ule)
+	struct udev_list_entry *frozen;
+	struct udev_list_node *node;
+	unsigned int i = 0;
+
+	if (ul->arena == NULL || ul->frozen != NULL || ul->count == 0)
+		return (0);
+
+	frozen = arena_alloc(ul->arena, ul->count * sizeof(*frozen));
+	if (frozen == NULL)
 		return (-1);
-	ule->list = ul;
-	strcpy(ule->name, name);
-	ule->value = NULL;
-	if (value != NULL) {
-		ule->value = ule->name + namelen;
-		strcpy(ule->value, value);
+
+	RB_FOREACH(node, udev_list_tree, &ul->tree)
+		frozen[i++] = node->entry;
+	assert(i == ul->count);
+
+	RB_INIT(&ul->tree);
+	memset(ul->index, 0, ul->index_size * sizeof(*ul->index));
+	for (i = 0; i < ul->count; i++)
+		*udev_list_index_slot(ul, frozen[i].name, frozen[i].hash) =
+		    &frozen[i];
+	ul->frozen = frozen;
+	return (0);
+}
+
+/*
+ * Makes list reference entries of frozen template list which must outlive
+ * it. The entries are copied to the list own arena on the first
+ * modification, so the template is never changed.
+ */
+int
+udev_list_share(struct udev_list *ul, struct udev_list *tmpl)
+{
+	struct udev_list_entry *ule;
+
+	if (ul->arena != NULL && ul->count == 0 && tmpl->frozen != NULL) {
+		ul->frozen = tmpl->frozen;
+		ul->index = tmpl->index;
+		ul->index_size = tmpl->index_size;
+		ul->count = tmpl->count;
+		return (0);
 	}
-	old_ule = RB_FIND(udev_list, ul, ule);
-	if (old_ule != NULL) {
-		RB_REMOVE(udev_list, ul, old_ule);
-		udev_list_entry_free(ule);
+
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(tmpl))
+		if (udev_list_insert(ul, ule->name, ule->value) == -1)
+			return (-1);
+
+	return (0);
+}
+
+/*
+ * Makes list hold entries of @p src, which unlike udev_list_share()
+ * template may be released first. Entries @p src shares from a template
+ * are shared as well, others are copied.
+ */
+int
+udev_list_inherit(struct udev_list *ul, struct udev_list *src)
+{
+	struct udev_list_entry *ule;
+
+	/* Entries of a shared array belong to the template list */
+	if (src->frozen != NULL && src->frozen->list != src)
+		return (udev_list_share(ul, src));
+
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(src))
+		if (udev_list_insert(ul, ule->name, ule->value) == -1)
+			return (-1);
+
+	return (0);
+}
+
+/* Folds names and values of list entries into FNV-1a @p hash */
+uint32_t
+udev_list_digest(struct udev_list *ul, uint32_t hash)
+{
+	struct udev_list_entry *ule;
+	const char *s;
+
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(ul)) {
+		for (s = ule->name; *s != '\0'; s++)
+			hash = (hash ^ (unsigned char)*s) * 16777619u;
+		hash = (hash ^ '=') * 16777619u;
+		for (s = ule->value; s != NULL && *s != '\0'; s++)
+			hash = (hash ^ (unsigned char)*s) * 16777619u;
+		hash = (hash ^ '\n') * 16777619u;
 	}
+
+	return (hash);
+}
+
+/* Checks that both lists hold the same names with the same values */
+bool
+udev_list_equal(struct udev_list *ul1, struct udev_list *ul2)
+{
+	struct udev_list_entry *ule1, *ule2;
+
+	if (ul1->count != ul2->count)
+		return (false);
+
+	for (ule1 = udev_list_entry_get_first(ul1),
+	     ule2 = udev_list_entry_get_first(ul2);
+	     ule1 != NULL && ule2 != NULL;
+	     ule1 = udev_list_entry_get_next(ule1),
+	     ule2 = udev_list_entry_get_next(ule2)) {
+		if (strcmp(ule1->name, ule2->name) != 0)
+			return (false);
+		if (ule1->value != ule2->value && (ule1->value == NULL ||
+		    ule2->value == NULL || strcmp(ule1->value, ule2->value) != 0))
+			return (false);
+	}
+
+	return (true);
+}
+
+static int
+udev_list_thaw(struct udev_list *ul)
+{
+	struct udev_list_entry *frozen, *ule;
+	struct udev_list_node *node;
+	unsigned int i, count;
+
+	frozen = ul->frozen;
+	count = ul->count;
+	ul->frozen = NULL;
+	/* Index may be shared with template, a new one is made */
+	ul->index = NULL;
+	ul->index_size = 0;
+	ul->count = 0;
+	for (i = 0; i < count; i++) {
+		/* Names and values are kept in place */
+		node = arena_alloc(ul->arena, sizeof(struct udev_list_node));
+		if (node == NULL)
+			return (-1);
+		ule = &node->entry;
+		*ule = frozen[i];
+		if (udev_list_insert_entry(ul, ule) == -1)
+			return (-1);
+	}
+
 	return (0);
 }
-#endif
+
+static void
+udev_list_reparent(struct udev_list *ul, struct udev_list *old)
+{
+	struct udev_list_node *node;
+	unsigned int i;
+
+	RB_FOREACH(node, udev_list_tree, &ul->tree)
+		node->entry.list = ul;
+	/* Entries shared with template keep pointing to the template */
+	if (ul->frozen != NULL)
+		for (i = 0; i < ul->count; i++)
+			if (ul->frozen[i].list == old)
+				ul->frozen[i].list = ul;
+}
+
+/* Exchanges contents of two lists. Entries stay in place. */
+void
+udev_list_swap(struct udev_list *ul1, struct udev_list *ul2)
+{
+	struct udev_list tmp;
+
+	tmp = *ul1;
+	*ul1 = *ul2;
+	*ul2 = tmp;
+
+	/* Any entry pointing to ul1 now belongs to ul2 and vice versa */
+	udev_list_reparent(ul1, ul2);
+	udev_list_reparent(ul2, ul1);
+}
 
 void
 udev_list_free(struct udev_list *ul)
 {
-	struct udev_list_entry *ule1, *ule2;
+	struct udev_list_node *node1, *node2;
 
-	RB_FOREACH_SAFE (ule1, udev_list, ul, ule2) {
-		RB_REMOVE(udev_list, ul, ule1);
-		udev_list_entry_free(ule1);
+	if (ul->arena == NULL) {
+		RB_FOREACH_SAFE (node1, udev_list_tree, &ul->tree, node2) {
+			RB_REMOVE(udev_list_tree, &ul->tree, node1);
+			udev_list_entry_free(ul, &node1->entry);
+		}
+		free(ul->index);
 	}
 
-	RB_INIT(ul);
+	RB_INIT(&ul->tree);
+	ul->index = NULL;
+	ul->index_size = 0;
+	ul->count = 0;
+	ul->frozen = NULL;
 }
 
 static struct udev_list_entry *
-udev_list_entry_alloc(const char *name, const char *value)
+udev_list_entry_alloc(struct arena *arena, const char *name, const char *value)
 {
+	struct udev_list_node *node;
 	struct udev_list_entry *ule;
-	size_t namelen, valuelen;
+	const char *atom;
+	size_t namelen, valuelen, size;
+	uint32_t hash;
 
-	namelen = strlen(name) + 1;
+	hash = udev_list_hash(name);
+	atom = udev_atom_find(name, hash);
+	namelen = atom != NULL ? 0 : strlen(name) + 1;
 	valuelen = value == NULL ? 0 : strlen(value) + 1;
-	ule = calloc
-	    (1, offsetof(struct udev_list_entry, name) + namelen + valuelen);
-	if (ule != NULL) {
-		strcpy(ule->name, name);
-		if (value != NULL) {
-			ule->value = ule->name + namelen;
-			strcpy(ule->value, value);
-		}
+	size = offsetof(struct udev_list_node, data) + namelen + valuelen;
+	if (arena != NULL)
+		node = arena_alloc(arena, size);
+	else
+		node = malloc(size);
+	if (node == NULL)
+		return (NULL);
+
+	ule = &node->entry;
+	ule->hash = hash;
+	ule->atom = atom != NULL;
+	if (atom != NULL)
+		ule->name = atom;
+	else {
+		memcpy(node->data, name, namelen);
+		ule->name = node->data;
+	}
+	ule->value = NULL;
+	if (value != NULL) {
+		ule->value = node->data + namelen;
+		memcpy(ule->value, value, valuelen);
 	}
 
 	return (ule);
 }
 
 static void
-udev_list_entry_free(struct udev_list_entry *ule)
+udev_list_entry_free(struct udev_list *ul, struct udev_list_entry *ule)
 {
 
-	free(ule);
+	if (ul->arena == NULL)
+		free(UDEV_LIST_NODE(ule));
 }
 
 struct udev_list_entry *
 udev_list_entry_get_first(struct udev_list *ul)
 {
+	struct udev_list_node *node;
+
+	if (ul->frozen != NULL)
+		return (ul->frozen);
 
-	return (RB_MIN(udev_list, ul));
+	node = RB_MIN(udev_list_tree, &ul->tree);
+	return (node != NULL ? &node->entry : NULL);
 }
 
 LIBUDEV_EXPORT struct udev_list_entry *
 udev_list_entry_get_next(struct udev_list_entry *ule)
 {
+	struct udev_list *ul;
+	struct udev_list_node *node;
 
-	return (ule != NULL ? RB_NEXT(udev_list,, ule) : NULL);
+	if (ule == NULL)
+		return (NULL);
+
+	ul = ule->list;
+	if (ul->frozen != NULL)
+		return (ule + 1 < ul->frozen + ul->count ? ule + 1 : NULL);
+
+	node = RB_NEXT(udev_list_tree,, UDEV_LIST_NODE(ule));
+	return (node != NULL ? &node->entry : NULL);
 }
 
 const char *
@@ -237,29 +758,14 @@ udev_list_entry_get_value(struct udev_list_entry *ule)
 	return (value);
 }
 
-static int
-udev_list_entry_cmp (struct udev_list_entry *le1, struct udev_list_entry *le2)
-{
-
-	return (strcmp(le1->name, le2->name));
-}
-
 LIBUDEV_EXPORT struct udev_list_entry *
 udev_list_entry_get_by_name(struct udev_list_entry *ule, const char *name)
 {
-	struct udev_list_entry *find, *ret;
 
 	if (ule == NULL)
 		return (NULL);
 
-	find = udev_list_entry_alloc(name, NULL);
-	if (find == NULL)
-		return (NULL);
-
-	ret = RB_FIND(udev_list, ule->list, find);
-	udev_list_entry_free(find);
-
-	return (ret);
+	return (udev_list_find(ule->list, name));
 }
 
-RB_GENERATE(udev_list, udev_list_entry, link, udev_list_entry_cmp);
+RB_GENERATE(udev_list_tree, udev_list_node, link, udev_list_node_cmp);
@@ -29,9 +29,19 @@
 #include "config.h"
 #include "utils.h"
 
-RB_HEAD(udev_list, udev_list_entry);
+RB_HEAD(udev_list_tree, udev_list_node);
+
+struct udev_list {
+	struct udev_list_tree tree;
+	struct arena *arena;	/* entries storage, NULL for malloc() */
+	struct udev_list_entry **index;	/* hash index of tree entries */
+	unsigned int index_size;	/* number of index slots, power of 2 */
+	unsigned int count;
+	struct udev_list_entry *frozen;	/* sorted entries of frozen list */
+};
 
 void udev_list_init(struct udev_list *ul);
+void udev_list_init_arena(struct udev_list *ul, struct arena *arena);
 int udev_list_insert(struct udev_list *ul, char const *name,
     char const *value);
 int udev_list_insertf(struct udev_list *ul, char const *name,
@@ -42,7 +52,17 @@ int udev_list_remove(struct udev_list *ul, char const *name,
 int udev_list_member(struct udev_list *ul, char const *name,
     char const *value);
 #endif
+int udev_list_freeze(struct udev_list *ul);
+int udev_list_share(struct udev_list *ul, struct udev_list *tmpl);
+int udev_list_inherit(struct udev_list *ul, struct udev_list *src);
+uint32_t udev_list_digest(struct udev_list *ul, uint32_t hash);
+void udev_list_swap(struct udev_list *ul1, struct udev_list *ul2);
+bool udev_list_equal(struct udev_list *ul1, struct udev_list *ul2);
 void udev_list_free(struct udev_list *ul);
+struct udev_list_entry *udev_list_find(struct udev_list *ul, const char *name);
+struct udev_list_entry *udev_list_lower_bound(struct udev_list *ul,
+    const char *name);
+const char *udev_list_atom(const char *name);
 struct udev_list_entry *udev_list_entry_get_first(struct udev_list *ul);
 const char *_udev_list_entry_get_name(struct udev_list_entry *ule);
 const char *_udev_list_entry_get_value(struct udev_list_entry *ule);
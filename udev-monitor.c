@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/queue.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 
 #if defined(__OpenBSD__)
@@ -39,6 +40,7 @@
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,13 +63,14 @@ struct udev_monitor_queue_entry {
 };
 
 struct udev_monitor {
-	int refcount;
+	atomic_int refcount;
 	int fds[2];
 	struct udev_filter_head filters;
 	struct udev *udev;
 	struct udev_monitor_queue_head queue;
 	pthread_mutex_t mtx;
 	pthread_t thread;
+	bool watching;		/* connected to devd, see _udev_watch() */
 #if defined(__OpenBSD__)
 	struct udev_list cur_dev_list;
 	struct udev_list prev_dev_list;
@@ -105,21 +108,45 @@ udev_monitor_receive_device(struct udev_monitor *um)
 	return (ud);
 }
 
+/*
+ * Queues device @p ud, taking over the reference, or a new one built for
+ * @p syspath if @p ud is NULL.
+ */
 static int
 udev_monitor_send_device(struct udev_monitor *um, const char *syspath,
-    int action)
+    int action, struct udev_device *ud)
 {
 	struct udev_monitor_queue_entry *umqe;
+	struct udev_device *cached;
 
 	umqe = calloc(1, sizeof(struct udev_monitor_queue_entry));
-	if (umqe == NULL)
+	if (umqe == NULL) {
+		if (ud != NULL)
+			udev_device_unref(ud);
 		return (-1);
+	}
 
-	umqe->ud = udev_device_new_common(um->udev, syspath, action);
+	umqe->ud = ud != NULL ? ud :
+	    udev_device_new_common(um->udev, syspath, action);
 	if (umqe->ud == NULL) {
 		free(umqe);
 		return (-1);
 	}
+	/*
+	 * Probe while the device is surely there, not when it is received,
+	 * and cache a copy to match its removal event against. Event device
+	 * carries the action, so it is not the one lookups are served with.
+	 */
+	if (action != UD_ACTION_REMOVE) {
+		udev_device_probe(umqe->ud);
+		cached = udev_device_new_common(um->udev, syspath,
+		    UD_ACTION_NONE);
+		if (cached != NULL) {
+			udev_device_probe(cached);
+			_udev_device_cache_put(um->udev, cached);
+			udev_device_unref(cached);
+		}
+	}
 
 	pthread_mutex_lock(&um->mtx);
 	STAILQ_INSERT_TAIL(&um->queue, umqe, next);
@@ -137,6 +164,26 @@ udev_monitor_send_device(struct udev_monitor *um, const char *syspath,
 	return (0);
 }
 
+/* Keeps process-wide devnum index in sync with device nodes */
+static void
+udev_monitor_update_devnum_index(const char *syspath, int action)
+{
+	struct stat st;
+
+	if (strncmp(syspath, DEV_PATH_ROOT "/", sizeof(DEV_PATH_ROOT)) != 0)
+		return;
+
+	switch (action) {
+	case UD_ACTION_ADD:
+		if (dev_stat(syspath, &st) == 0 && S_ISCHR(st.st_mode))
+			devnum_index_insert(st.ST_RDEV, syspath);
+		break;
+	case UD_ACTION_REMOVE:
+		devnum_index_remove(syspath);
+		break;
+	}
+}
+
 #if !defined(__OpenBSD__)
 #if defined(__NetBSD__)
 static int
@@ -166,6 +213,20 @@ parse_devd_message(char *msg, char *syspath, size_t syspathlen)
 }
 #endif
 
+/*
+ * While connected to devd the monitor sees every device event, so cached
+ * enumeration results of its udev context can be validated by generation.
+ */
+static void
+udev_monitor_watch(struct udev_monitor *um, bool watch)
+{
+
+	if (um->watching != watch) {
+		um->watching = watch;
+		_udev_watch(um->udev, watch);
+	}
+}
+
 static void *
 udev_monitor_thread(void *args)
 {
@@ -179,6 +240,7 @@ udev_monitor_thread(void *args)
 	size_t ev_len = sizeof(ev);
 #endif
 	char syspath[DEV_PATH_MAX];
+	struct udev_device *ud;
 	struct pollfd fds[2];
 	nfds_t nfds;
 	ssize_t len;
@@ -203,6 +265,7 @@ udev_monitor_thread(void *args)
 			close(devd_fd);
 			devd_fd = -1;
 		}
+		udev_monitor_watch(um, devd_fd >= 0);
 
 		if (devd_fd < 0) {
 			nfds = 1;
@@ -234,6 +297,7 @@ udev_monitor_thread(void *args)
 				devd_fd = -1;
 				continue;
 			}
+			_udev_generation_bump(um->udev);
 #if defined(__NetBSD__)
 			action = parse_ndevd_message(event, syspath, sizeof(syspath));
 			if (strncmp(syspath, "/dev/uhid", 9) == 0 && isdigit((unsigned char)syspath[9])) {
@@ -253,9 +317,12 @@ udev_monitor_thread(void *args)
 			ev[len - 1] = '\0';
 			action = parse_devd_message(ev, syspath, sizeof(syspath));
 #endif
+			udev_monitor_update_devnum_index(syspath, action);
 			if (action != UD_ACTION_NONE &&
-			    udev_filter_match(um->udev, &um->filters, syspath))
-				udev_monitor_send_device(um, syspath, action);
+			    udev_filter_match(um->udev, &um->filters, syspath,
+			    action, &ud))
+				udev_monitor_send_device(um, syspath, action,
+				    ud);
 		}
 
 		if (fds[1].revents & POLLHUP) {
@@ -266,13 +333,15 @@ udev_monitor_thread(void *args)
 
 	if (devd_fd >= 0)
 		close(devd_fd);
+	udev_monitor_watch(um, false);
 
 	return (NULL);
 }
 #else
 
 static int
-obsd_enumerate_cb(const char *path, mode_t type, void *arg)
+obsd_enumerate_cb(int dirfd, const char *name, const char *path,
+    mode_t type, void *arg)
 {
 	struct udev_monitor *um = arg;
 	const char *syspath;
@@ -281,7 +350,7 @@ obsd_enumerate_cb(const char *path, mode_t type, void *arg)
 	syspath = get_syspath_by_devpath(path);
 	sc = get_subsystem_config_by_syspath(syspath);
 	if (sc && (S_ISLNK(type) || S_ISCHR(type)) &&
-            ((devfd = open(syspath, O_RDWR)) != -1)) {
+            ((devfd = dev_open(syspath, O_RDWR)) != -1)) {
 		if (udev_list_insert(&um->cur_dev_list, syspath, NULL) == -1) {
 			if (devfd != -1)
 				close(devfd);
@@ -301,8 +370,9 @@ udev_monitor_thread(void *args)
 	char path[DEV_PATH_MAX] = DEV_PATH_ROOT "/";
 	char path_fido[DEV_PATH_MAX] = DEV_PATH_ROOT "/fido/";
 	struct scandir_ctx mctx;
+	struct udev_device *ud;
 	int found;
-	struct udev_list_entry *ce, *pe;
+	struct udev_list_entry *ce, *pe, *pn;
 	size_t size = sizeof(&um->cur_serial);
 	sigfillset(&set);
 	pthread_sigmask(SIG_BLOCK, &set, NULL);
@@ -314,8 +384,8 @@ udev_monitor_thread(void *args)
 
 	/* scan and fill the initial tree */
 	pthread_mutex_lock(&scan_mtx);
-	if ((scandir_recursive(path, sizeof(path), &mctx) == 0) &&
-		(scandir_recursive(path_fido, sizeof(path_fido), &mctx) == 0)) {
+	if ((scandir_dev(path, &mctx) == 0) &&
+		(scandir_dev(path_fido, &mctx) == 0)) {
 		udev_list_entry_foreach(ce, udev_list_entry_get_first(&um->cur_dev_list)) {
 			if (!_udev_list_entry_get_name(ce))
 				continue;
@@ -332,8 +402,8 @@ udev_monitor_thread(void *args)
 		/* reinit the current device list */
 		udev_list_free(&um->cur_dev_list);
 		pthread_mutex_lock(&scan_mtx);
-		if ((scandir_recursive(path, sizeof(path), &mctx) == -1) &&
-			(scandir_recursive(path_fido, sizeof(path_fido), &mctx) == -1)) 
+		if ((scandir_dev(path, &mctx) == -1) &&
+			(scandir_dev(path_fido, &mctx) == -1)) 
 			printf("failed to scan\n");
 		pthread_mutex_unlock(&scan_mtx);
 		/* attach */
@@ -343,20 +413,26 @@ udev_monitor_thread(void *args)
 				continue;
 			if (udev_list_member(&um->prev_dev_list, _udev_list_entry_get_name(ce), NULL))
 				found = 1;
-			if (!found && udev_filter_match(um->udev, &um->filters, _udev_list_entry_get_name(ce))) {
-				udev_monitor_send_device(um, _udev_list_entry_get_name(ce), UD_ACTION_ADD);
+			if (!found)
+				udev_monitor_update_devnum_index(_udev_list_entry_get_name(ce), UD_ACTION_ADD);
+			if (!found && udev_filter_match(um->udev, &um->filters, _udev_list_entry_get_name(ce), UD_ACTION_ADD, &ud)) {
+				udev_monitor_send_device(um, _udev_list_entry_get_name(ce), UD_ACTION_ADD, ud);
 				udev_list_insert(&um->prev_dev_list, udev_list_entry_get_name(ce), NULL);
 			}
 		}
 		/* detach */
-		udev_list_entry_foreach(pe, udev_list_entry_get_first(&um->prev_dev_list)) {
+		for (pe = udev_list_entry_get_first(&um->prev_dev_list);
+		     pe != NULL; pe = pn) {
+			pn = udev_list_entry_get_next(pe);
 			found = 0;
 			if (!_udev_list_entry_get_name(pe))
 				continue;
 			if (udev_list_member(&um->cur_dev_list, _udev_list_entry_get_name(pe), NULL))
 				found = 1;
-			if (!found && udev_filter_match(um->udev, &um->filters, _udev_list_entry_get_name(pe))) {
-				udev_monitor_send_device(um, _udev_list_entry_get_name(pe), UD_ACTION_REMOVE);
+			if (!found)
+				udev_monitor_update_devnum_index(_udev_list_entry_get_name(pe), UD_ACTION_REMOVE);
+			if (!found && udev_filter_match(um->udev, &um->filters, _udev_list_entry_get_name(pe), UD_ACTION_REMOVE, &ud)) {
+				udev_monitor_send_device(um, _udev_list_entry_get_name(pe), UD_ACTION_REMOVE, ud);
 				udev_list_remove(&um->prev_dev_list, udev_list_entry_get_name(pe), NULL);
 			}
 		}
@@ -387,7 +463,7 @@ udev_monitor_new_from_netlink(struct udev *udev, const char *name)
 
 	um->udev = udev;
 	_udev_ref(udev);
-	um->refcount = 1;
+	atomic_init(&um->refcount, 1);
 	udev_filter_init(&um->filters);
 	STAILQ_INIT(&um->queue);
 #if defined(__OpenBSD__)
@@ -445,7 +521,7 @@ udev_monitor_ref(struct udev_monitor *um)
 {
 
 	TRC("(%p) refcount=%d", um, um->refcount);
-	++um->refcount;
+	atomic_fetch_add_explicit(&um->refcount, 1, memory_order_relaxed);
 	return (um);
 }
 
@@ -466,10 +542,13 @@ LIBUDEV_EXPORT void
 udev_monitor_unref(struct udev_monitor *um)
 {
 	TRC("(%p) refcount=%d", um, um->refcount);
-	if (--um->refcount == 0) {
+	if (atomic_fetch_sub_explicit(&um->refcount, 1,
+	    memory_order_acq_rel) == 1) {
 		close(um->fds[0]);
 		pthread_cancel(um->thread);
 		pthread_join(um->thread, NULL);
+		/* Thread may have been cancelled while connected */
+		udev_monitor_watch(um, false);
 		close(um->fds[1]);
 		udev_filter_free(&um->filters);
 #if defined(__OpenBSD__)
@@ -112,6 +112,27 @@ udev_net_monitor(char *msg, char *syspath, size_t syspathlen)
 	return (action);
 }
 
+/* Checks that interface @p ifname exists without listing all of them */
+bool
+udev_net_lookup(const char *ifname)
+{
+
+	return (if_nametoindex(ifname) != 0);
+}
+
+/* Builds syspath of interface @p ifindex, NULL if there is no such one */
+const char *
+udev_net_lookup_index(unsigned int ifindex, char *syspath, size_t len)
+{
+	char ifname[IFNAMSIZ];
+
+	if (if_indextoname(ifindex, ifname) == NULL ||
+	    (size_t)snprintf(syspath, len, "/net/%s", ifname) >= len)
+		return (NULL);
+
+	return (syspath);
+}
+
 void
 create_net_handler(struct udev_device *ud)
 {
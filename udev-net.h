@@ -34,5 +34,8 @@ create_node_handler_t	create_net_handler;
 
 int udev_net_enumerate(struct udev_enumerate *ue);
 int udev_net_monitor(char *msg, char *syspath, size_t syspathlen);
+bool udev_net_lookup(const char *ifname);
+const char *udev_net_lookup_index(unsigned int ifindex, char *syspath,
+    size_t len);
 
 #endif /* UDEV_NET_H_ */
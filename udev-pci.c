@@ -74,12 +74,12 @@ static int
 udev_pci_enumerate_cb(struct devinfo_dev *dev, void *arg)
 {
 	char syspath[DEV_PATH_MAX] = "/pci/";
-	struct udev_enumerate *ue = arg;
+	struct udev_list *found = arg;
 
 	if (!devd2udev_dbsf(dev->dd_location, syspath + 5, sizeof(syspath) - 5))
 		return (0);
 
-	return (udev_enumerate_add_device(ue, syspath));
+	return (udev_list_insert(found, syspath, NULL));
 }
 #endif
 
@@ -87,12 +87,21 @@ int
 udev_pci_enumerate(struct udev_enumerate *ue)
 {
 #ifdef HAVE_DEVINFO_H
+	struct udev_list found;
 	struct scandev_ctx ctx = {
 		.cb = udev_pci_enumerate_cb,
-		.args = ue,
+		.args = &found,
 	};
+	int ret;
 
-	return (scandev_recursive(&ctx));
+	/* Devices are probed after devinfo snapshot is released */
+	udev_list_init(&found);
+	ret = scandev_recursive(&ctx);
+	if (ret == 0)
+		ret = udev_enumerate_add_devices(ue, &found);
+	udev_list_free(&found);
+
+	return (ret);
 #else
 	return (0);
 #endif
@@ -125,27 +134,19 @@ udev_pci_monitor(char *msg, char *syspath, size_t syspathlen)
 	return (action);
 }
 
-void
-create_pci_handler(struct udev_device *ud)
-{
 #ifdef HAVE_DEVINFO_H
+/* Reads configuration of a single PCI function with one ioctl */
+static int
+pci_getconf(unsigned int dom, unsigned int bus, unsigned int slot,
+    unsigned int func, struct pci_conf *conf)
+{
 	struct pci_conf_io pc;
-	struct pci_conf conf;
 	struct pci_match_conf patterns;
-	const char *dbsf;
-	struct udev_list *props, *attrs;
-	unsigned int dom, bus, slot, func, class;
-	int fd;
-
-	dbsf = _udev_device_get_sysname(ud);
-	if (sscanf(dbsf, "%x:%x:%x.%x", &dom, &bus, &slot, &func) != 4) {
-		ERR("Invalid syspath dbsf value: %s", dbsf);
-		return;
-	}
+	int fd, ret = -1;
 
 	bzero(&pc, sizeof(struct pci_conf_io));
-	pc.match_buf_len = sizeof(conf);
-	pc.matches = &conf;
+	pc.match_buf_len = sizeof(*conf);
+	pc.matches = conf;
 	pc.num_patterns = 1;
 	pc.pat_buf_len = sizeof(patterns);
 	pc.patterns = &patterns;
@@ -162,19 +163,54 @@ create_pci_handler(struct udev_device *ud)
 	fd = open(_PATH_DEVPCI, O_RDONLY | O_CLOEXEC, 0);
 	if (fd < 0) {
 		ERR("Failed to open %s", _PATH_DEVPCI);
-		return;
+		return (-1);
 	}
 
-	if (ioctl(fd, PCIOCGETCONF, &pc) == -1) {
+	if (ioctl(fd, PCIOCGETCONF, &pc) == -1)
 		ERR("Failed to ioctl(PCIOCGETCONF)");
-		goto out;
-	}
-
-	if (pc.status != PCI_GETCONF_LAST_DEVICE) {
+	else if (pc.status != PCI_GETCONF_LAST_DEVICE)
 		ERR("Bad ioctl(PCIOCGETCONF) status: %d", pc.status);
-		goto out;
+	else if (pc.num_matches == 1)
+		ret = 0;
+
+	close(fd);
+	return (ret);
+}
+#endif
+
+/* Checks that PCI function @p dbsf exists without scanning the bus */
+bool
+udev_pci_lookup(const char *dbsf)
+{
+#ifdef HAVE_DEVINFO_H
+	struct pci_conf conf;
+	unsigned int dom, bus, slot, func;
+
+	return (sscanf(dbsf, "%x:%x:%x.%x", &dom, &bus, &slot, &func) == 4 &&
+	    pci_getconf(dom, bus, slot, func, &conf) == 0);
+#else
+	return (false);
+#endif
+}
+
+void
+create_pci_handler(struct udev_device *ud)
+{
+#ifdef HAVE_DEVINFO_H
+	struct pci_conf conf;
+	const char *dbsf;
+	struct udev_list *props, *attrs;
+	unsigned int dom, bus, slot, func, class;
+
+	dbsf = _udev_device_get_sysname(ud);
+	if (sscanf(dbsf, "%x:%x:%x.%x", &dom, &bus, &slot, &func) != 4) {
+		ERR("Invalid syspath dbsf value: %s", dbsf);
+		return;
 	}
 
+	if (pci_getconf(dom, bus, slot, func, &conf) != 0)
+		return;
+
 	class = (conf.pc_class << 16)|(conf.pc_subclass << 8)|conf.pc_progif;
 
 	props = udev_device_get_properties_list(ud);
@@ -210,8 +246,5 @@ create_pci_handler(struct udev_device *ud)
 	    conf.pc_vendor, conf.pc_device,
 	    conf.pc_subvendor, conf.pc_subdevice,
 	    dom, bus, slot, func);
-
-out:
-	close(fd);
 #endif
 }
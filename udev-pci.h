@@ -32,5 +32,6 @@ create_node_handler_t	create_pci_handler;
 
 int udev_pci_enumerate(struct udev_enumerate *ue);
 int udev_pci_monitor(char *msg, char *syspath, size_t syspathlen);
+bool udev_pci_lookup(const char *dbsf);
 
 #endif /* UDEV_PCI_H_ */
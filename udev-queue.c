@@ -28,6 +28,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -39,7 +40,7 @@
 #endif
 
 struct udev_queue {
-	int refcount;
+	atomic_int refcount;
 	struct udev *udev;
 	int fd;
 };
@@ -56,7 +57,7 @@ udev_queue_new(struct udev *udev)
 
 	uq->udev = udev;
 	udev_ref(udev);
-	uq->refcount = 1;
+	atomic_init(&uq->refcount, 1);
 	uq->fd = -1;
 
 	return (uq);
@@ -66,7 +67,7 @@ LIBUDEV_EXPORT struct udev_queue *
 udev_queue_ref(struct udev_queue *uq)
 {
 	TRC("(%p) refcount=%d", uq, uq->refcount);
-	++uq->refcount;
+	atomic_fetch_add_explicit(&uq->refcount, 1, memory_order_relaxed);
 	return (uq);
 }
 
@@ -74,7 +75,8 @@ LIBUDEV_EXPORT struct udev_queue *
 udev_queue_unref(struct udev_queue *uq)
 {
 	TRC("(%p) refcount=%d", uq, uq->refcount);
-	if (--uq->refcount == 0) {
+	if (atomic_fetch_sub_explicit(&uq->refcount, 1,
+	    memory_order_acq_rel) == 1) {
 		if (uq->fd >= 0)
 			close(uq->fd);
 		udev_unref(uq->udev);
@@ -37,13 +37,13 @@ static int
 udev_sys_enumerate_cb(struct devinfo_dev *dev, void *arg)
 {
 	char syspath[DEV_PATH_MAX] = "/sys/";
-	struct udev_enumerate *ue = arg;
+	struct udev_list *found = arg;
 
 	if (dev->dd_name[0] == '\0' || dev->dd_state < DS_ATTACHED)
 		return (0);
 
 	strlcat(syspath, dev->dd_name, sizeof(syspath));
-	return (udev_enumerate_add_device(ue, syspath));
+	return (udev_list_insert(found, syspath, NULL));
 }
 #endif
 
@@ -51,12 +51,21 @@ int
 udev_sys_enumerate(struct udev_enumerate *ue)
 {
 #ifdef HAVE_DEVINFO_H
+	struct udev_list found;
 	struct scandev_ctx ctx = {
 		.cb = udev_sys_enumerate_cb,
-		.args = ue,
+		.args = &found,
 	};
+	int ret;
 
-	return (scandev_recursive(&ctx));
+	/* Devices are probed after devinfo snapshot is released */
+	udev_list_init(&found);
+	ret = scandev_recursive(&ctx);
+	if (ret == 0)
+		ret = udev_enumerate_add_devices(ue, &found);
+	udev_list_free(&found);
+
+	return (ret);
 #else
 	return (0);
 #endif
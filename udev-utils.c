@@ -33,8 +33,15 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -47,6 +54,36 @@ struct devnum_scan_args {
 	size_t	len;
 };
 
+/*
+ * Process-wide reverse index of character device numbers to syspaths. It
+ * is filled by enumerations and devnum lookups and updated by monitor
+ * events. Entries are verified with a single stat() when looked up, so a
+ * stale one costs a rescan only. Enumeration walks do not stat nodes,
+ * the syspaths they pass are kept pending and stated on the first lookup
+ * missing the index.
+ */
+#define	DEVNUM_INDEX_BUCKETS	256
+
+struct devnum_index_entry {
+	struct devnum_index_entry *next;
+	dev_t	devnum;
+	char	syspath[];
+};
+
+static struct devnum_index_entry *devnum_index[DEVNUM_INDEX_BUCKETS];
+static pthread_mutex_t devnum_index_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct udev_list devnum_index_pending = {
+	.tree = RB_INITIALIZER(&devnum_index_pending.tree),
+};
+
+/*
+ * File system location of DEV_PATH_ROOT, empty for itself. Tests point it
+ * to a fixture tree. Syspaths and device nodes keep DEV_PATH_ROOT prefix,
+ * only file system accesses made through get_dev_fspath() and its users
+ * are redirected.
+ */
+static char dev_root[PATH_MAX];
+
 struct subsystem_config {
 	char *subsystem;
 	char *devtype;
@@ -59,6 +96,8 @@ struct subsystem_config {
 /* Flag which in indicates a device should be skipped because it's
  * already exposed through EVDEV when it's enabled. */
 #define	SCFLAG_SKIP_IF_EVDEV	0x01
+/* Devices are reported by enumerator itself rather than device sources */
+#define	SCFLAG_NO_SOURCE	0x02
 
 static const struct subsystem_config subsystems[] = {
 	{
@@ -170,9 +209,48 @@ static const struct subsystem_config subsystems[] = {
 		.create_handler = create_mouse_handler,
 	},
 #endif
-
+	{
+		.subsystem = "subsystem",
+		.syspath = "/sys/bus/*",
+		.flags = SCFLAG_NO_SOURCE,
+	},
 };
 
+/*
+ * Names of subsystems of the table above, each listed once. Used to report
+ * subsystems without scanning devices.
+ */
+static const char *subsystem_names[nitems(subsystems)];
+static size_t subsystem_names_count;
+static pthread_once_t subsystem_names_once = PTHREAD_ONCE_INIT;
+
+static void
+subsystem_names_init(void)
+{
+	size_t i, j;
+
+	for (i = 0; i < nitems(subsystems); i++) {
+		if (subsystems[i].flags & SCFLAG_NO_SOURCE)
+			continue;
+		for (j = 0; j < subsystem_names_count; j++)
+			if (strcmp(subsystem_names[j],
+			    subsystems[i].subsystem) == 0)
+				break;
+		if (j == subsystem_names_count)
+			subsystem_names[subsystem_names_count++] =
+			    subsystems[i].subsystem;
+	}
+}
+
+const char *const *
+get_subsystem_names(size_t *count)
+{
+
+	pthread_once(&subsystem_names_once, subsystem_names_init);
+	*count = subsystem_names_count;
+	return (subsystem_names);
+}
+
 const struct subsystem_config *
 get_subsystem_config_by_syspath(const char *path)
 {
@@ -185,26 +263,88 @@ get_subsystem_config_by_syspath(const char *path)
 	return (NULL);
 }
 
-static bool
-kernel_has_evdev_enabled()
+static bool kernel_has_evdev_enabled();
+
+/*
+ * Stores syspath globs of device nodes whose subsystems may pass subsystem
+ * filters in @p ufh to @p globs and returns their number. Directory parts
+ * of the globs in the subsystems table are literal.
+ */
+size_t
+get_dev_syspath_globs(struct udev_filter_head *ufh, const char **globs,
+    size_t nglobs)
 {
-	static int enabled = -1;
-#ifdef HAVE_SYSCTLBYNAME
-	size_t len;
-#endif
+	const char *glob;
+	size_t i, n = 0;
+
+	for (i = 0; i < nitems(subsystems) && n < nglobs; i++) {
+		glob = subsystems[i].syspath;
+		if (strncmp(glob, DEV_PATH_ROOT "/",
+		    sizeof(DEV_PATH_ROOT)) != 0)
+			continue;
+		assert(strcspn(glob, "*?[\\") > strbase(glob) - glob - 1);
+		if (subsystems[i].flags & SCFLAG_SKIP_IF_EVDEV &&
+		    kernel_has_evdev_enabled())
+			continue;
+		if (udev_filter_match_subsystem(ufh, subsystems[i].subsystem))
+			globs[n++] = glob;
+	}
 
-	if (enabled != -1)
-		return (enabled);
+	return (n);
+}
 
+/*
+ * Returns true if devices with syspaths starting with @p prefix may pass
+ * subsystem filters in @p ufh, according to the subsystems table.
+ */
+bool
+syspath_prefix_match_subsystem(const char *prefix,
+    struct udev_filter_head *ufh)
+{
+	size_t i, len;
+
+	len = strlen(prefix);
+	for (i = 0; i < nitems(subsystems); i++) {
+		if (strncmp(subsystems[i].syspath, prefix, len) != 0 ||
+		    subsystems[i].flags & SCFLAG_NO_SOURCE)
+			continue;
+		if (subsystems[i].flags & SCFLAG_SKIP_IF_EVDEV &&
+		    kernel_has_evdev_enabled())
+			continue;
+		if (udev_filter_match_subsystem(ufh, subsystems[i].subsystem))
+			return (true);
+	}
+
+	return (false);
+}
+
+static bool evdev_enabled;
+static pthread_once_t evdev_once = PTHREAD_ONCE_INIT;
+
+static void
+kernel_has_evdev_init(void)
+{
 #ifdef HAVE_SYSCTLBYNAME
-	if (sysctlbyname("kern.features.evdev_support", &enabled, &len, NULL, 0) < 0)
-		return (0);
+	size_t len;
+	int enabled;
+
+	len = sizeof(enabled);
+	if (sysctlbyname("kern.features.evdev_support", &enabled, &len,
+	    NULL, 0) == 0)
+		evdev_enabled = enabled != 0;
 #else
-	enabled = 1;
+	evdev_enabled = true;
 #endif
 
-	TRC("() EVDEV enabled: %s", enabled ? "true" : "false");
-	return (enabled);
+	TRC("() EVDEV enabled: %s", evdev_enabled ? "true" : "false");
+}
+
+static bool
+kernel_has_evdev_enabled()
+{
+
+	pthread_once(&evdev_once, kernel_has_evdev_init);
+	return (evdev_enabled);
 }
 
 const char *
@@ -255,14 +395,15 @@ get_syspath_by_devpath(const char *devpath)
 }
 
 static int
-get_syspath_by_devnum_cb(const char *path, mode_t type, void *args)
+get_syspath_by_devnum_cb(int dirfd, const char *name, const char *path,
+    mode_t type, void *args)
 {
 	struct devnum_scan_args *sa = args;
 	struct stat st;
 
 	if (S_ISLNK(type) &&
 	    fnmatch(sa->pattern, path, 0) == 0 &&
-	    stat(path, &st) == 0 &&
+	    fstatat(dirfd, name, &st, 0) == 0 &&
 	    st.ST_RDEV == sa->devnum) {
 		strlcpy(sa->path, path, sa->len);
 		return (-1);
@@ -270,6 +411,160 @@ get_syspath_by_devnum_cb(const char *path, mode_t type, void *args)
 	return (0);
 }
 
+/* Fixture trees are made of symbolic links to real device nodes */
+static int
+get_devpath_by_devnum_cb(int dirfd, const char *name, const char *path,
+    mode_t type, void *args)
+{
+	struct devnum_scan_args *sa = args;
+	struct stat st;
+
+	if ((S_ISCHR(type) || S_ISLNK(type)) &&
+	    fstatat(dirfd, name, &st, 0) == 0 &&
+	    S_ISCHR(st.st_mode) && st.ST_RDEV == sa->devnum) {
+		strlcpy(sa->path, path, sa->len);
+		return (-1);
+	}
+	return (0);
+}
+
+static inline size_t
+devnum_index_bucket(dev_t devnum)
+{
+	uint64_t h = (uint64_t)devnum * 0x9e3779b97f4a7c15ULL;
+
+	return ((size_t)(h >> 56) % DEVNUM_INDEX_BUCKETS);
+}
+
+void
+devnum_index_insert(dev_t devnum, const char *syspath)
+{
+	struct devnum_index_entry *die, **diep;
+	size_t len;
+
+	len = strlen(syspath) + 1;
+	pthread_mutex_lock(&devnum_index_mtx);
+	for (diep = &devnum_index[devnum_index_bucket(devnum)]; *diep != NULL;
+	    diep = &(*diep)->next) {
+		if ((*diep)->devnum != devnum)
+			continue;
+		if (strcmp((*diep)->syspath, syspath) == 0) {
+			pthread_mutex_unlock(&devnum_index_mtx);
+			return;
+		}
+		/* Device number has been reused by another node */
+		die = *diep;
+		*diep = die->next;
+		free(die);
+		break;
+	}
+	die = malloc(offsetof(struct devnum_index_entry, syspath) + len);
+	if (die != NULL) {
+		die->devnum = devnum;
+		memcpy(die->syspath, syspath, len);
+		diep = &devnum_index[devnum_index_bucket(devnum)];
+		die->next = *diep;
+		*diep = die;
+	}
+	pthread_mutex_unlock(&devnum_index_mtx);
+}
+
+/* Drops entries of @p syspath. Node is gone so its number is unknown. */
+void
+devnum_index_remove(const char *syspath)
+{
+	struct devnum_index_entry *die, **diep;
+	size_t i;
+
+	pthread_mutex_lock(&devnum_index_mtx);
+	for (i = 0; i < DEVNUM_INDEX_BUCKETS; i++) {
+		for (diep = &devnum_index[i]; *diep != NULL;) {
+			die = *diep;
+			if (strcmp(die->syspath, syspath) == 0) {
+				*diep = die->next;
+				free(die);
+			} else
+				diep = &die->next;
+		}
+	}
+	pthread_mutex_unlock(&devnum_index_mtx);
+}
+
+/* Queues @p syspath passed by enumeration to be indexed when needed */
+void
+devnum_index_note(const char *syspath)
+{
+
+	pthread_mutex_lock(&devnum_index_mtx);
+	udev_list_insert(&devnum_index_pending, syspath, NULL);
+	pthread_mutex_unlock(&devnum_index_mtx);
+}
+
+/* Stats pending syspaths and indexes device nodes among them */
+static bool
+devnum_index_flush(void)
+{
+	struct udev_list pending;
+	struct udev_list_entry *ule;
+	struct stat st;
+
+	udev_list_init(&pending);
+	pthread_mutex_lock(&devnum_index_mtx);
+	udev_list_swap(&pending, &devnum_index_pending);
+	pthread_mutex_unlock(&devnum_index_mtx);
+	if (udev_list_entry_get_first(&pending) == NULL)
+		return (false);
+
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(&pending))
+		if (dev_stat(_udev_list_entry_get_name(ule), &st) == 0 &&
+		    S_ISCHR(st.st_mode))
+			devnum_index_insert(st.ST_RDEV,
+			    _udev_list_entry_get_name(ule));
+	udev_list_free(&pending);
+
+	return (true);
+}
+
+static char *
+devnum_index_find(dev_t devnum)
+{
+	struct devnum_index_entry *die;
+	char *syspath = NULL;
+
+	pthread_mutex_lock(&devnum_index_mtx);
+	for (die = devnum_index[devnum_index_bucket(devnum)]; die != NULL;
+	    die = die->next) {
+		if (die->devnum == devnum) {
+			syspath = strdup(die->syspath);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&devnum_index_mtx);
+
+	return (syspath);
+}
+
+/* Returns copy of indexed syspath of @p devnum if it still refers to it */
+static char *
+devnum_index_lookup(dev_t devnum)
+{
+	struct stat st;
+	char *syspath;
+
+	syspath = devnum_index_find(devnum);
+	if (syspath == NULL && devnum_index_flush())
+		syspath = devnum_index_find(devnum);
+
+	if (syspath != NULL && (dev_stat(syspath, &st) != 0 ||
+	    !S_ISCHR(st.st_mode) || st.ST_RDEV != devnum)) {
+		devnum_index_remove(syspath);
+		free(syspath);
+		syspath = NULL;
+	}
+
+	return (syspath);
+}
+
 const char *
 get_syspath_by_devnum(dev_t devnum)
 {
@@ -279,12 +574,34 @@ get_syspath_by_devnum(dev_t devnum)
 	struct scandir_ctx ctx;
 	struct devnum_scan_args args;
 	const char *linkbase;
+	char *syspath;
 	size_t dev_len, linkdir_len, i;
 
+	syspath = devnum_index_lookup(devnum);
+	if (syspath != NULL) {
+		TRC("(%d) -> %s (indexed)", (int)devnum, syspath);
+		return (syspath);
+	}
+
 	dev_len = strlen(devpath);
-	devname_r(devnum, S_IFCHR, devpath + dev_len, sizeof(devpath) - dev_len);
+	if (dev_root[0] != '\0') {
+		/* Fixture nodes are unknown to devname_r(3) */
+		args = (struct devnum_scan_args) {
+			.devnum = devnum,
+			.path = devpath,
+			.len = sizeof(devpath),
+		};
+		ctx = (struct scandir_ctx) {
+			.recursive = true,
+			.cb = get_devpath_by_devnum_cb,
+			.args = &args,
+		};
+		scandir_dev(devpath, &ctx);
+	} else
+		devname_r(devnum, S_IFCHR, devpath + dev_len,
+		    sizeof(devpath) - dev_len);
 	/* Recheck path as devname_r returns zero-terminated garbage on error */
-	if (stat(devpath, &st) != 0 || st.ST_RDEV != devnum) {
+	if (dev_stat(devpath, &st) != 0 || st.ST_RDEV != devnum) {
 		TRC("(%d) -> failed", (int)devnum);
 		return NULL;
 	}
@@ -311,14 +628,132 @@ get_syspath_by_devnum(dev_t devnum)
 				.cb = get_syspath_by_devnum_cb,
 				.args = &args,
 			};
-			if (scandir_recursive(linkdir, sizeof(linkdir), &ctx) == -1)
+			if (scandir_dev(linkdir, &ctx) == -1)
 				break;
 		}
 	}
 
+	devnum_index_insert(devnum, devpath);
 	return (strdup(devpath));
 }
 
+/*
+ * Resolves @p subsystem and @p sysname to syspath without scanning. The
+ * candidate is built from directory part of each matching subsystems
+ * table glob and checked with a single stat() or interface/PCI lookup.
+ */
+const char *
+get_syspath_by_subsystem_sysname(const char *subsystem, const char *sysname,
+    char *syspath, size_t len)
+{
+	const char *glob;
+	size_t dirlen, i, j, nnames;
+	const char *const *names;
+	struct stat st;
+	bool found;
+
+	if (strchr(sysname, '/') != NULL)
+		return (NULL);
+
+	for (i = 0; i < nitems(subsystems); i++) {
+		if (strcmp(subsystems[i].subsystem, subsystem) != 0)
+			continue;
+		if (subsystems[i].flags & SCFLAG_SKIP_IF_EVDEV &&
+		    kernel_has_evdev_enabled())
+			continue;
+		glob = subsystems[i].syspath;
+		dirlen = strbase(glob) - glob;
+		if ((size_t)snprintf(syspath, len, "%.*s%s", (int)dirlen, glob,
+		    sysname) >= len ||
+		    fnmatch(glob, syspath, 0) != 0)
+			continue;
+
+		if (strncmp(syspath, DEV_PATH_ROOT "/",
+		    sizeof(DEV_PATH_ROOT)) == 0)
+			found = dev_stat(syspath, &st) == 0 &&
+			    S_ISCHR(st.st_mode);
+		else if (strncmp(syspath, "/net/", 5) == 0)
+			found = udev_net_lookup(sysname);
+		else if (strncmp(syspath, "/pci/", 5) == 0)
+			found = udev_pci_lookup(sysname);
+		else {
+			names = get_subsystem_names(&nnames);
+			for (j = 0, found = false; j < nnames && !found; j++)
+				found = strcmp(names[j], sysname) == 0;
+		}
+		if (found) {
+			TRC("(%s, %s) -> %s", subsystem, sysname, syspath);
+			return (syspath);
+		}
+	}
+
+	TRC("(%s, %s) -> not found", subsystem, sysname);
+	return (NULL);
+}
+
+/* Sets fixture tree to read device nodes from, NULL for DEV_PATH_ROOT */
+void
+set_dev_root(const char *root)
+{
+
+	strlcpy(dev_root, root != NULL ? root : "", sizeof(dev_root));
+}
+
+/*
+ * Returns file system path of @p path, which is @p path itself unless it
+ * is under relocated DEV_PATH_ROOT. Returns NULL if @p buf is too short.
+ */
+const char *
+get_dev_fspath(const char *path, char *buf, size_t len)
+{
+	const char *rel;
+
+	rel = path + sizeof(DEV_PATH_ROOT) - 1;
+	if (dev_root[0] == '\0' ||
+	    strncmp(path, DEV_PATH_ROOT, sizeof(DEV_PATH_ROOT) - 1) != 0 ||
+	    (*rel != '/' && *rel != '\0'))
+		return (path);
+
+	if ((size_t)snprintf(buf, len, "%s%s", dev_root, rel) >= len) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+	return (buf);
+}
+
+int
+dev_stat(const char *path, struct stat *st)
+{
+	char buf[PATH_MAX];
+
+	path = get_dev_fspath(path, buf, sizeof(buf));
+	return (path != NULL ? stat(path, st) : -1);
+}
+
+int
+dev_open(const char *path, int flags)
+{
+	char buf[PATH_MAX];
+
+	path = get_dev_fspath(path, buf, sizeof(buf));
+	return (path != NULL ? open(path, flags) : -1);
+}
+
+/* scandir_recursive() of a directory under DEV_PATH_ROOT */
+int
+scandir_dev(const char *path, struct scandir_ctx *ctx)
+{
+	char buf[PATH_MAX];
+
+	ctx->fspath = get_dev_fspath(path, buf, sizeof(buf));
+	if (ctx->fspath == NULL)
+		return (0);
+	if (ctx->fspath == path)
+		ctx->fspath = NULL;
+
+	return (scandir_recursive(path, ctx));
+}
+
 void
 invoke_create_handler(struct udev_device *ud)
 {
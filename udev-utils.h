@@ -26,7 +26,10 @@
 #ifndef UDEV_UTILS_H_
 #define UDEV_UTILS_H_
 
+struct scandir_ctx;
+struct stat;
 struct udev_device;
+struct udev_filter_head;
 
 #define	LIBUDEV_EXPORT	__attribute__((visibility("default")))
 
@@ -49,8 +52,24 @@ const char *get_sysname_by_syspath(const char *syspath);
 const char *get_devpath_by_syspath(const char *syspath);
 const char *get_syspath_by_devpath(const char *devpath);
 const char *get_syspath_by_devnum(dev_t devnum);
+const char *get_syspath_by_subsystem_sysname(const char *subsystem,
+    const char *sysname, char *syspath, size_t len);
+void devnum_index_insert(dev_t devnum, const char *syspath);
+void devnum_index_remove(const char *syspath);
+void devnum_index_note(const char *syspath);
 
 const struct subsystem_config *get_subsystem_config_by_syspath(const char *path);
+const char *const *get_subsystem_names(size_t *count);
+bool syspath_prefix_match_subsystem(const char *prefix,
+    struct udev_filter_head *ufh);
+size_t get_dev_syspath_globs(struct udev_filter_head *ufh, const char **globs,
+    size_t nglobs);
+
+void set_dev_root(const char *root);
+const char *get_dev_fspath(const char *path, char *buf, size_t len);
+int dev_stat(const char *path, struct stat *st);
+int dev_open(const char *path, int flags);
+int scandir_dev(const char *path, struct scandir_ctx *ctx);
 
 void invoke_create_handler(struct udev_device *ud);
 size_t syspathlen_wo_units(const char *path);
@@ -23,26 +23,132 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "udev-global.h"
 
+/*
+ * Results of recent enumerations. Entry is valid while device generation
+ * has not changed. While some monitor is watching for devd events every
+ * device change advances the generation, so nothing else is checked and
+ * a hit costs no system calls. Otherwise the entry must have been stamped
+ * by the sources it was read from, see udev_dev_stamp(), and the stamp
+ * must still be the same.
+ */
+#define	UDEV_SCAN_CACHE_SIZE	8
+
+struct udev_scan_cache_entry {
+	char *key;		/* normalized filter set, NULL if unused */
+	unsigned int generation;
+	uint64_t stamp;		/* /dev fingerprint or 0 */
+	struct udev_list result;
+};
+
+/*
+ * Parent to children links of devices are kept as "parent\nchild" named
+ * entries of a sorted list, so children of a device are found with a range
+ * lookup. The index is valid under the same conditions as scan cache.
+ */
+struct udev_children_index {
+	bool valid;
+	unsigned int generation;
+	uint64_t stamp;
+	struct udev_list links;
+};
+
+/*
+ * Recently built devices shared by all lookups by syspath. Entry is valid
+ * while device generation has not changed. Without a monitor running
+ * only device nodes are cached, and they are checked to be the same node.
+ * devfs reuses inode and device numbers, so the node change time has to
+ * match as well.
+ * Cached devices hold references to the context, so the cache is dropped
+ * once the last reference taken with udev_new() or udev_ref() is released.
+ */
+#define	UDEV_DEVICE_CACHE_SIZE	64
+
+struct udev_device_cache_node {
+	ino_t ino;		/* 0 if not a device node */
+	dev_t rdev;
+	struct timespec ctim;
+};
+
+struct udev_device_cache_entry {
+	struct udev_device *ud;	/* NULL if unused */
+	uint32_t hash;
+	unsigned int generation;
+	struct udev_device_cache_node node;
+	unsigned long used;	/* LRU clock value of the last lookup */
+};
+
+/*
+ * Synthetic parents of devices, shared by siblings. Entries are keyed by
+ * parent sysname and a hash of its contents, so siblings declaring the
+ * same sysname with different contents get parents of their own. Entries
+ * do not hold references, a parent leaves the table when its last child
+ * releases it.
+ */
+#define	UDEV_PARENT_BUCKETS	32
+
+struct udev_parent_entry {
+	struct udev_parent_entry *next;
+	struct udev_device *ud;
+	uint32_t hash;
+	uint32_t content;
+};
+
 struct udev {
-	int refcount;
+	atomic_int refcount;
+	atomic_uint users;	/* references taken by library users */
 	void *userdata;
+	atomic_ulong stats[UDEV_STAT_CNT];
+	atomic_uint generation;	/* advanced on every device event */
+	atomic_uint watchers;	/* monitors connected to devd */
+	pthread_mutex_t cache_mtx;
+	bool cache_closed;	/* device cache flushed by last udev_unref() */
+	unsigned int cache_next;	/* entry to be replaced next */
+	struct udev_scan_cache_entry cache[UDEV_SCAN_CACHE_SIZE];
+	struct udev_children_index children;
+	unsigned long device_clock;
+	struct udev_device_cache_entry devices[UDEV_DEVICE_CACHE_SIZE];
+	pthread_mutex_t parents_mtx;
+	struct udev_parent_entry *parents[UDEV_PARENT_BUCKETS];
 };
 
+static void
+udev_scan_cache_clear(struct udev_scan_cache_entry *usce)
+{
+
+	free(usce->key);
+	usce->key = NULL;
+	udev_list_free(&usce->result);
+}
+
 LIBUDEV_EXPORT struct udev *
 udev_new(void)
 {
 	struct udev *udev;
+	size_t i;
 
 	TRC();
 	udev = calloc(1, sizeof(struct udev));
 	if (udev) {
 		udev->refcount = 1;
+		udev->users = 1;
 		udev->userdata = NULL;
+		pthread_mutex_init(&udev->cache_mtx, NULL);
+		pthread_mutex_init(&udev->parents_mtx, NULL);
+		for (i = 0; i < UDEV_SCAN_CACHE_SIZE; i++)
+			udev_list_init(&udev->cache[i].result);
+		udev_list_init(&udev->children.links);
 #if defined(__NetBSD__)
 		fido_global_init();
 #endif
@@ -55,7 +161,7 @@ struct udev *
 _udev_ref(struct udev *udev)
 {
 
-	++udev->refcount;
+	atomic_fetch_add_explicit(&udev->refcount, 1, memory_order_relaxed);
 	return udev;
 }
 
@@ -64,17 +170,48 @@ udev_ref(struct udev *udev)
 {
 
 	TRC("(%p) refcount=%d", udev, udev->refcount);
+	atomic_fetch_add_explicit(&udev->users, 1, memory_order_relaxed);
 	return (_udev_ref(udev));
 }
 
+static void
+udev_device_cache_flush(struct udev *udev)
+{
+	struct udev_device *stale[UDEV_DEVICE_CACHE_SIZE];
+	size_t i, n = 0;
+
+	/* Devices still held by the caller must not be put back */
+	pthread_mutex_lock(&udev->cache_mtx);
+	udev->cache_closed = true;
+	for (i = 0; i < UDEV_DEVICE_CACHE_SIZE; i++) {
+		if (udev->devices[i].ud == NULL)
+			continue;
+		stale[n++] = udev->devices[i].ud;
+		udev->devices[i].ud = NULL;
+	}
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	/* Releases context references held by the devices */
+	while (n > 0)
+		udev_device_unref(stale[--n]);
+}
+
 void
 _udev_unref(struct udev *udev)
 {
+	size_t i;
 
-	if (--udev->refcount == 0) {
+	if (atomic_fetch_sub_explicit(&udev->refcount, 1,
+	    memory_order_acq_rel) == 1) {
 #if defined(__NetBSD__)
 		fido_global_cleanup();
 #endif
+		for (i = 0; i < UDEV_SCAN_CACHE_SIZE; i++)
+			udev_scan_cache_clear(&udev->cache[i]);
+		udev_list_free(&udev->children.links);
+		pthread_mutex_destroy(&udev->cache_mtx);
+		/* Parents hold context references, so the table is empty */
+		pthread_mutex_destroy(&udev->parents_mtx);
 		free(udev);
 	}
 }
@@ -84,9 +221,503 @@ udev_unref(struct udev *udev)
 {
 
 	TRC("(%p) refcount=%d", udev, udev->refcount);
+	if (atomic_fetch_sub_explicit(&udev->users, 1,
+	    memory_order_acq_rel) == 1)
+		udev_device_cache_flush(udev);
 	_udev_unref(udev);
 }
 
+void
+_udev_stat_inc(struct udev *udev, enum udev_stat stat)
+{
+
+	atomic_fetch_add_explicit(&udev->stats[stat], 1, memory_order_relaxed);
+}
+
+unsigned int
+_udev_generation(struct udev *udev)
+{
+
+	return (atomic_load_explicit(&udev->generation, memory_order_acquire));
+}
+
+/* Called by monitors on every device event and on devd (dis)connection */
+void
+_udev_generation_bump(struct udev *udev)
+{
+
+	atomic_fetch_add_explicit(&udev->generation, 1, memory_order_acq_rel);
+}
+
+void
+_udev_watch(struct udev *udev, bool watch)
+{
+
+	if (watch)
+		atomic_fetch_add_explicit(&udev->watchers, 1,
+		    memory_order_acq_rel);
+	else
+		atomic_fetch_sub_explicit(&udev->watchers, 1,
+		    memory_order_acq_rel);
+	_udev_generation_bump(udev);
+}
+
+bool
+_udev_watched(struct udev *udev)
+{
+
+	return (atomic_load_explicit(&udev->watchers,
+	    memory_order_acquire) != 0);
+}
+
+/*
+ * Checks entry made at @p entry_generation with @p entry_stamp against
+ * current generation and stamp, which is 0 if the sources can not be
+ * stamped or some monitor is watching.
+ */
+static bool
+udev_cache_valid(struct udev *udev, unsigned int entry_generation,
+    uint64_t entry_stamp, unsigned int generation, uint64_t stamp)
+{
+
+	if (entry_generation != generation)
+		return (false);
+	if (_udev_watched(udev))
+		return (true);
+
+	return (stamp != 0 && entry_stamp == stamp);
+}
+
+/*
+ * Copies cached enumeration result for filter set @p key to @p ul.
+ * Returns 0 on cache hit.
+ */
+int
+_udev_scan_cache_lookup(struct udev *udev, const char *key,
+    unsigned int generation, uint64_t stamp, struct udev_list *ul)
+{
+	struct udev_scan_cache_entry *usce;
+	struct udev_list_entry *ule;
+	size_t i;
+	int ret = -1;
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	for (i = 0; i < UDEV_SCAN_CACHE_SIZE; i++) {
+		usce = &udev->cache[i];
+		if (usce->key == NULL || strcmp(usce->key, key) != 0)
+			continue;
+		if (!udev_cache_valid(udev, usce->generation, usce->stamp,
+		    generation, stamp))
+			break;
+		ret = 0;
+		udev_list_entry_foreach(ule,
+		    udev_list_entry_get_first(&usce->result))
+			if (udev_list_insert(ul,
+			    _udev_list_entry_get_name(ule), NULL) == -1) {
+				ret = -1;
+				break;
+			}
+		break;
+	}
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	_udev_stat_inc(udev, ret == 0 ?
+	    UDEV_STAT_SCAN_CACHE_HITS : UDEV_STAT_SCAN_CACHE_MISSES);
+	return (ret);
+}
+
+void
+_udev_scan_cache_store(struct udev *udev, const char *key,
+    unsigned int generation, uint64_t stamp, struct udev_list *ul)
+{
+	struct udev_scan_cache_entry *usce = NULL;
+	struct udev_list_entry *ule;
+	size_t i;
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	for (i = 0; i < UDEV_SCAN_CACHE_SIZE; i++)
+		if (udev->cache[i].key != NULL &&
+		    strcmp(udev->cache[i].key, key) == 0)
+			usce = &udev->cache[i];
+	if (usce == NULL) {
+		usce = &udev->cache[udev->cache_next];
+		udev->cache_next = (udev->cache_next + 1) % UDEV_SCAN_CACHE_SIZE;
+	}
+
+	udev_scan_cache_clear(usce);
+	usce->key = strdup(key);
+	if (usce->key == NULL)
+		goto out;
+	usce->generation = generation;
+	usce->stamp = stamp;
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(ul))
+		if (udev_list_insert(&usce->result,
+		    _udev_list_entry_get_name(ule), NULL) == -1) {
+			udev_scan_cache_clear(usce);
+			break;
+		}
+out:
+	pthread_mutex_unlock(&udev->cache_mtx);
+}
+
+static uint32_t
+udev_device_cache_hash(const char *syspath)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *syspath != '\0'; syspath++)
+		hash = (hash ^ (unsigned char)*syspath) * 16777619u;
+
+	return (hash);
+}
+
+/*
+ * Fills identity of device node @p syspath. Inode is set to 0 if it is not
+ * a device node. Symbolic links are followed as they may be repointed.
+ */
+static void
+udev_device_cache_node(const char *syspath,
+    struct udev_device_cache_node *node)
+{
+	struct stat st;
+
+	memset(node, 0, sizeof(*node));
+	if (strncmp(syspath, DEV_PATH_ROOT "/", sizeof(DEV_PATH_ROOT)) != 0 ||
+	    dev_stat(syspath, &st) != 0)
+		return;
+
+	node->ino = st.st_ino;
+	node->rdev = st.st_rdev;
+	node->ctim = st.st_ctim;
+}
+
+static bool
+udev_device_cache_node_equal(const struct udev_device_cache_node *a,
+    const struct udev_device_cache_node *b)
+{
+
+	return (a->ino == b->ino && a->rdev == b->rdev &&
+	    a->ctim.tv_sec == b->ctim.tv_sec &&
+	    a->ctim.tv_nsec == b->ctim.tv_nsec);
+}
+
+/*
+ * Adds device to the cache, replacing least recently used entry. Cache
+ * takes its own reference.
+ */
+void
+_udev_device_cache_put(struct udev *udev, struct udev_device *ud)
+{
+	struct udev_device_cache_entry *udce, *victim;
+	struct udev_device_cache_node node;
+	struct udev_device *stale;
+	const char *syspath;
+	uint32_t hash;
+	size_t i;
+
+	syspath = _udev_device_get_syspath(ud);
+	if (_udev_watched(udev))
+		memset(&node, 0, sizeof(node));
+	else {
+		udev_device_cache_node(syspath, &node);
+		if (node.ino == 0)
+			return;
+	}
+	hash = udev_device_cache_hash(syspath);
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	/* Nobody is going to ask for it, cached reference would leak */
+	if (udev->cache_closed ||
+	    atomic_load_explicit(&udev->users, memory_order_acquire) == 0) {
+		pthread_mutex_unlock(&udev->cache_mtx);
+		return;
+	}
+	victim = &udev->devices[0];
+	for (i = 0; i < UDEV_DEVICE_CACHE_SIZE; i++) {
+		udce = &udev->devices[i];
+		if (udce->ud != NULL && udce->hash == hash &&
+		    strcmp(_udev_device_get_syspath(udce->ud), syspath) == 0) {
+			victim = udce;
+			break;
+		}
+		if (victim->ud != NULL &&
+		    (udce->ud == NULL || udce->used < victim->used))
+			victim = udce;
+	}
+	stale = victim->ud;
+	victim->ud = udev_device_ref(ud);
+	victim->hash = hash;
+	victim->generation = _udev_generation(udev);
+	victim->node = node;
+	victim->used = ++udev->device_clock;
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	if (stale != NULL)
+		udev_device_unref(stale);
+}
+
+/*
+ * Returns new reference to cached device with given @p syspath or NULL.
+ */
+struct udev_device *
+_udev_device_cache_get(struct udev *udev, const char *syspath)
+{
+	struct udev_device_cache_entry *udce;
+	struct udev_device_cache_node node;
+	struct udev_device *ud = NULL, *stale = NULL;
+	uint32_t hash;
+	size_t i;
+
+	hash = udev_device_cache_hash(syspath);
+	pthread_mutex_lock(&udev->cache_mtx);
+	for (i = 0; i < UDEV_DEVICE_CACHE_SIZE; i++) {
+		udce = &udev->devices[i];
+		if (udce->ud == NULL || udce->hash != hash ||
+		    strcmp(_udev_device_get_syspath(udce->ud), syspath) != 0)
+			continue;
+		if (udce->node.ino != 0)
+			udev_device_cache_node(syspath, &node);
+		if (udce->generation == _udev_generation(udev) &&
+		    (udce->node.ino == 0 ? _udev_watched(udev) :
+		     udev_device_cache_node_equal(&udce->node, &node))) {
+			ud = udev_device_ref(udce->ud);
+			udce->used = ++udev->device_clock;
+		} else {
+			stale = udce->ud;
+			udce->ud = NULL;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	if (stale != NULL)
+		udev_device_unref(stale);
+	_udev_stat_inc(udev, ud != NULL ?
+	    UDEV_STAT_DEVICE_CACHE_HITS : UDEV_STAT_DEVICE_CACHE_MISSES);
+	return (ud);
+}
+
+/*
+ * Returns new reference to device cached with given @p syspath, even if
+ * the entry is no longer valid, or NULL. Used to match removal events
+ * against what was known about the device.
+ */
+struct udev_device *
+_udev_device_cache_last(struct udev *udev, const char *syspath)
+{
+	struct udev_device_cache_entry *udce;
+	struct udev_device *ud = NULL;
+	uint32_t hash;
+	size_t i;
+
+	hash = udev_device_cache_hash(syspath);
+	pthread_mutex_lock(&udev->cache_mtx);
+	for (i = 0; i < UDEV_DEVICE_CACHE_SIZE; i++) {
+		udce = &udev->devices[i];
+		if (udce->ud != NULL && udce->hash == hash &&
+		    strcmp(_udev_device_get_syspath(udce->ud), syspath) == 0) {
+			ud = udev_device_ref(udce->ud);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	return (ud);
+}
+
+/* Drops cache reference to @p ud if it holds one */
+void
+_udev_device_cache_evict(struct udev *udev, struct udev_device *ud)
+{
+	struct udev_device *stale = NULL;
+	size_t i;
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	for (i = 0; i < UDEV_DEVICE_CACHE_SIZE; i++) {
+		if (udev->devices[i].ud == ud) {
+			stale = ud;
+			udev->devices[i].ud = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	if (stale != NULL)
+		udev_device_unref(stale);
+}
+
+/* Adds syspaths of all descendants of @p parent found in @p links to @p ul */
+static int
+udev_children_collect(struct udev_list *links, const char *parent,
+    struct udev_list *ul)
+{
+	struct udev_list_entry *ule;
+	const char *child;
+	char *prefix;
+	size_t len;
+	int ret = 0;
+
+	len = strlen(parent);
+	prefix = malloc(len + 2);
+	if (prefix == NULL)
+		return (-1);
+	memcpy(prefix, parent, len);
+	strcpy(prefix + len, "\n");
+
+	for (ule = udev_list_lower_bound(links, prefix);
+	     ule != NULL && ret == 0;
+	     ule = udev_list_entry_get_next(ule)) {
+		if (strncmp(_udev_list_entry_get_name(ule), prefix,
+		    len + 1) != 0)
+			break;
+		child = _udev_list_entry_get_name(ule) + len + 1;
+		/* Already seen via another parent */
+		if (udev_list_find(ul, child) != NULL)
+			continue;
+		ret = udev_list_insert(ul, child, NULL);
+		if (ret == 0)
+			ret = udev_children_collect(links, child, ul);
+	}
+
+	free(prefix);
+	return (ret);
+}
+
+/*
+ * Adds devices of @p parents and all their descendants to @p ul.
+ * Returns 0 if the index was valid and the lookup has succeeded.
+ */
+int
+_udev_children_lookup(struct udev *udev, unsigned int generation,
+    uint64_t stamp, struct udev_list *parents, struct udev_list *ul)
+{
+	struct udev_children_index *uci = &udev->children;
+	struct udev_list_entry *ule;
+	int ret = -1;
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	if (!uci->valid || !udev_cache_valid(udev, uci->generation,
+	    uci->stamp, generation, stamp))
+		goto out;
+
+	ret = 0;
+	udev_list_entry_foreach(ule, udev_list_entry_get_first(parents)) {
+		ret = udev_list_insert(ul, _udev_list_entry_get_name(ule),
+		    NULL);
+		if (ret == 0)
+			ret = udev_children_collect(&uci->links,
+			    _udev_list_entry_get_name(ule), ul);
+		if (ret == -1)
+			break;
+	}
+out:
+	pthread_mutex_unlock(&udev->cache_mtx);
+
+	return (ret);
+}
+
+/* Replaces the index with @p links, which are left empty */
+void
+_udev_children_store(struct udev *udev, unsigned int generation,
+    uint64_t stamp, struct udev_list *links)
+{
+	struct udev_children_index *uci = &udev->children;
+
+	pthread_mutex_lock(&udev->cache_mtx);
+	udev_list_free(&uci->links);
+	udev_list_swap(&uci->links, links);
+	uci->generation = generation;
+	uci->stamp = stamp;
+	uci->valid = true;
+	pthread_mutex_unlock(&udev->cache_mtx);
+}
+
+/*
+ * Returns new reference to live parent with given @p sysname and contents
+ * hash or NULL.
+ */
+struct udev_device *
+_udev_parent_get(struct udev *udev, const char *sysname, uint32_t content)
+{
+	struct udev_parent_entry *upe;
+	struct udev_device *ud = NULL;
+	uint32_t hash;
+
+	hash = udev_device_cache_hash(sysname);
+	pthread_mutex_lock(&udev->parents_mtx);
+	for (upe = udev->parents[hash % UDEV_PARENT_BUCKETS]; upe != NULL;
+	    upe = upe->next) {
+		if (upe->hash == hash && upe->content == content &&
+		    strcmp(_udev_device_get_syspath(upe->ud), sysname) == 0) {
+			if (_udev_device_tryref(upe->ud))
+				ud = upe->ud;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&udev->parents_mtx);
+
+	return (ud);
+}
+
+/* Makes @p ud the parent returned for its sysname and contents from now on */
+void
+_udev_parent_put(struct udev *udev, struct udev_device *ud, uint32_t content)
+{
+	struct udev_parent_entry *upe, **bucket;
+	const char *sysname;
+	uint32_t hash;
+
+	sysname = _udev_device_get_syspath(ud);
+	hash = udev_device_cache_hash(sysname);
+	bucket = &udev->parents[hash % UDEV_PARENT_BUCKETS];
+	pthread_mutex_lock(&udev->parents_mtx);
+	for (upe = *bucket; upe != NULL; upe = upe->next)
+		if (upe->hash == hash && upe->content == content &&
+		    strcmp(_udev_device_get_syspath(upe->ud), sysname) == 0)
+			break;
+	if (upe == NULL && (upe = malloc(sizeof(*upe))) != NULL) {
+		upe->hash = hash;
+		upe->content = content;
+		upe->next = *bucket;
+		*bucket = upe;
+	}
+	if (upe != NULL)
+		upe->ud = ud;
+	pthread_mutex_unlock(&udev->parents_mtx);
+}
+
+/* Called for parent being released, drops its entry if it still has one */
+void
+_udev_parent_forget(struct udev *udev, struct udev_device *ud)
+{
+	struct udev_parent_entry *upe, **upep;
+	uint32_t hash;
+
+	hash = udev_device_cache_hash(_udev_device_get_syspath(ud));
+	pthread_mutex_lock(&udev->parents_mtx);
+	for (upep = &udev->parents[hash % UDEV_PARENT_BUCKETS];
+	    (upe = *upep) != NULL; upep = &upe->next) {
+		if (upe->ud == ud) {
+			*upep = upe->next;
+			free(upe);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&udev->parents_mtx);
+}
+
+LIBUDEV_EXPORT unsigned long
+udev_get_stat(struct udev *udev, enum udev_stat stat)
+{
+
+	TRC("(%p, %d)", udev, stat);
+	if (stat < 0 || stat >= UDEV_STAT_CNT)
+		return (0);
+
+	return (atomic_load_explicit(&udev->stats[stat],
+	    memory_order_relaxed));
+}
+
 LIBUDEV_EXPORT const char *
 udev_get_dev_path(struct udev *udev)
 {
@@ -26,9 +26,39 @@
 #ifndef UDEV_H_
 #define UDEV_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "libudev.h"
 
+struct udev_device;
+struct udev_list;
+
 struct udev *_udev_ref(struct udev *udev);
 void _udev_unref(struct udev *udev);
+void _udev_stat_inc(struct udev *udev, enum udev_stat stat);
+unsigned int _udev_generation(struct udev *udev);
+void _udev_generation_bump(struct udev *udev);
+void _udev_watch(struct udev *udev, bool watch);
+bool _udev_watched(struct udev *udev);
+int _udev_scan_cache_lookup(struct udev *udev, const char *key,
+    unsigned int generation, uint64_t stamp, struct udev_list *ul);
+void _udev_scan_cache_store(struct udev *udev, const char *key,
+    unsigned int generation, uint64_t stamp, struct udev_list *ul);
+int _udev_children_lookup(struct udev *udev, unsigned int generation,
+    uint64_t stamp, struct udev_list *parents, struct udev_list *ul);
+void _udev_children_store(struct udev *udev, unsigned int generation,
+    uint64_t stamp, struct udev_list *links);
+void _udev_device_cache_put(struct udev *udev, struct udev_device *ud);
+void _udev_device_cache_evict(struct udev *udev, struct udev_device *ud);
+struct udev_device *_udev_device_cache_get(struct udev *udev,
+    const char *syspath);
+struct udev_device *_udev_device_cache_last(struct udev *udev,
+    const char *syspath);
+struct udev_device *_udev_parent_get(struct udev *udev, const char *sysname,
+    uint32_t content);
+void _udev_parent_put(struct udev *udev, struct udev_device *ud,
+    uint32_t content);
+void _udev_parent_forget(struct udev *udev, struct udev_device *ud);
 
 #endif /* UDEV_H_ */
@@ -30,7 +30,12 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <locale.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -52,12 +57,167 @@
 static pthread_mutex_t devinfo_mtx = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-#ifndef HAVE_PIPE2
-#include <fcntl.h>
-#endif
 
 #include "utils.h"
 
+#define	ARENA_ALIGN	sizeof(void *)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+};
+
+void
+arena_init(struct arena *a, void *buf, size_t size)
+{
+
+	a->ptr = buf;
+	a->end = a->ptr + size;
+	a->chunks = NULL;
+}
+
+static char *
+arena_align(char *ptr)
+{
+
+	return ((char *)(((uintptr_t)ptr + ARENA_ALIGN - 1) &
+	    ~(uintptr_t)(ARENA_ALIGN - 1)));
+}
+
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_chunk *chunk;
+	size_t chunk_size;
+	char *ptr;
+
+	ptr = arena_align(a->ptr);
+	if (a->ptr == NULL || ptr > a->end || (size_t)(a->end - ptr) < size) {
+		chunk_size = size + ARENA_ALIGN > ARENA_CHUNK_SIZE ?
+		    size + ARENA_ALIGN : ARENA_CHUNK_SIZE;
+		chunk = malloc(sizeof(struct arena_chunk) + chunk_size);
+		if (chunk == NULL)
+			return (NULL);
+		chunk->next = a->chunks;
+		a->chunks = chunk;
+		a->ptr = (char *)(chunk + 1);
+		a->end = a->ptr + chunk_size;
+		ptr = arena_align(a->ptr);
+	}
+	a->ptr = ptr + size;
+
+	return (ptr);
+}
+
+/*
+ * Formats the string straight into the free space of the arena and
+ * only falls back to a fresh chunk when the output does not fit.
+ */
+char *
+arena_vasprintf(struct arena *a, const char *fmt, va_list ap)
+{
+	va_list aq;
+	size_t avail;
+	char *str;
+	int len;
+
+	avail = a->ptr == NULL ? 0 : a->end - a->ptr;
+	va_copy(aq, ap);
+	len = vsnprintf(a->ptr, avail, fmt, aq);
+	va_end(aq);
+	if (len < 0)
+		return (NULL);
+
+	if ((size_t)len < avail) {
+		str = a->ptr;
+		a->ptr += len + 1;
+		return (str);
+	}
+
+	str = arena_alloc(a, len + 1);
+	if (str != NULL)
+		vsnprintf(str, len + 1, fmt, ap);
+
+	return (str);
+}
+
+void
+arena_free(struct arena *a)
+{
+	struct arena_chunk *chunk;
+
+	while ((chunk = a->chunks) != NULL) {
+		a->chunks = chunk->next;
+		free(chunk);
+	}
+	a->ptr = a->end = NULL;
+}
+
+#define	FNPATTERN_META	"*?[\\"
+#define	FNPATTERN_UNIT_GLOB	"[0-9]*"
+
+/*
+ * fnmatch(3) evaluates bracket ranges in collation order of the current
+ * locale, which is byte order in single byte C and POSIX locales only.
+ */
+static bool
+fnpattern_byte_ranges(void)
+{
+	const char *collate;
+
+	if (MB_CUR_MAX != 1)
+		return (false);
+	collate = setlocale(LC_COLLATE, NULL);
+	return (collate != NULL &&
+	    (strcmp(collate, "C") == 0 || strcmp(collate, "POSIX") == 0));
+}
+
+void
+fnpattern_compile(struct fnpattern *fnp, const char *pattern)
+{
+	size_t len;
+
+	fnp->pattern = pattern;
+	fnp->literal = pattern;
+	fnp->len = len = strcspn(pattern, FNPATTERN_META);
+	if (pattern[len] == '\0')
+		fnp->type = FNPATTERN_LITERAL;
+	else if (strcmp(pattern + len, "*") == 0)
+		fnp->type = FNPATTERN_PREFIX;
+	else if (strcmp(pattern + len, FNPATTERN_UNIT_GLOB) == 0 &&
+	    fnpattern_byte_ranges())
+		fnp->type = FNPATTERN_UNIT;
+	else if (len == 0 && pattern[0] == '*' &&
+	    pattern[1 + strcspn(pattern + 1, FNPATTERN_META)] == '\0') {
+		fnp->type = FNPATTERN_SUFFIX;
+		fnp->literal = pattern + 1;
+		fnp->len = strlen(pattern + 1);
+	} else
+		fnp->type = FNPATTERN_GLOB;
+}
+
+/* Returns the same as fnmatch(pattern, string, 0) == 0 */
+bool
+fnpattern_match(const struct fnpattern *fnp, const char *string)
+{
+	size_t len;
+
+	switch (fnp->type) {
+	case FNPATTERN_LITERAL:
+		return (strcmp(fnp->literal, string) == 0);
+	case FNPATTERN_PREFIX:
+		return (strncmp(fnp->literal, string, fnp->len) == 0);
+	case FNPATTERN_UNIT:
+		return (strncmp(fnp->literal, string, fnp->len) == 0 &&
+		    string[fnp->len] >= '0' && string[fnp->len] <= '9');
+	case FNPATTERN_SUFFIX:
+		len = strlen(string);
+		return (len >= fnp->len &&
+		    memcmp(fnp->literal, string + len - fnp->len, fnp->len) == 0);
+	default:
+		return (fnmatch(fnp->pattern, string, 0) == 0);
+	}
+}
+
 /*
  * locates the occurrence of last component of the pathname
  * pointed to by path
@@ -180,59 +340,91 @@ out:
 	return (fd);
 }
 
+/*
+ * Directories are opened relative to their parents and entries are passed
+ * to callback by name, so walk costs one openat() per directory and no
+ * path lookups. Full paths are built in a single buffer shared by the
+ * whole walk.
+ */
 static int
-scandir_sub(char *path, int off, int rem, struct scandir_ctx *ctx)
+scandir_sub(int fd, char *path, size_t off, struct scandir_ctx *ctx)
 {
 	DIR *dir;
 	struct dirent *ent;
-	int ret = 0;
+	struct stat st;
+	mode_t type;
+	size_t len;
+	int subfd, ret = 0;
 
-	dir = opendir(path);
-	if (dir == NULL)
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		close(fd);
 		return (errno == ENOMEM ? -1 : 0);
+	}
 
 	while (ret >= 0 && (ent = readdir(dir)) != NULL) {
-		if (strcmp(ent->d_name, ".") == 0 ||
-		    strcmp(ent->d_name, "..") == 0)
+		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' ||
+		    (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
 			continue;
 
-		int len = strlen(ent->d_name);
-		if (len > rem)
+		len = strlen(ent->d_name);
+		if (off + len + 1 >= PATH_MAX) {
+			ERR("path too long: %s%s", path, ent->d_name);
+			continue;
+		}
+		memcpy(path + off, ent->d_name, len + 1);
+
+		if (ent->d_type != DT_UNKNOWN)
+			type = DTTOIF(ent->d_type);
+		else if (fstatat(dirfd(dir), ent->d_name, &st,
+		    AT_SYMLINK_NOFOLLOW) == 0)
+			type = st.st_mode & S_IFMT;
+		else
 			continue;
 
-		strcpy(path + off, ent->d_name);
-		off += len;
-		rem -= len;
-
-		if ((ctx->recursive) && (ent->d_type == DT_DIR)) {
-			if (rem < 1)
-				break;
-			path[off] = '/';
-			path[off+1] = '\0';
-			off++;
-			rem--;
+		if (ctx->recursive && S_ISDIR(type)) {
+			subfd = openat(dirfd(dir), ent->d_name,
+			    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (subfd == -1) {
+				ret = errno == ENOMEM ? -1 : 0;
+				continue;
+			}
+			path[off + len] = '/';
+			path[off + len + 1] = '\0';
 			/* recurse */
-			ret = scandir_sub(path, off, rem, ctx);
-			off--;
-			rem++;
-		} else {
-			ret = (ctx->cb)(path, DTTOIF(ent->d_type), ctx->args);
-		}
-		off -= len;
-		rem += len;
+			ret = scandir_sub(subfd, path, off + len + 1, ctx);
+		} else
+			ret = (ctx->cb)(dirfd(dir), ent->d_name, path, type,
+			    ctx->args);
 	}
+	path[off] = '\0';
 	closedir(dir);
 	return (ret);
 }
 
 int
-scandir_recursive(char *path, size_t len, struct scandir_ctx *ctx)
+scandir_recursive(const char *path, struct scandir_ctx *ctx)
 {
 	char rpath[PATH_MAX];
-	size_t root_len = strlen(path);
+	size_t len;
+	int fd;
+
+	len = strlcpy(rpath, path, sizeof(rpath));
+	if (len + 1 >= sizeof(rpath)) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	if (len == 0 || rpath[len - 1] != '/') {
+		rpath[len++] = '/';
+		rpath[len] = '\0';
+	}
+
+	fd = open(ctx->fspath != NULL ? ctx->fspath : rpath,
+	    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return (errno == ENOMEM ? -1 : 0);
 
-	strlcpy(rpath, path, sizeof(rpath));
-	return (scandir_sub(rpath, root_len, len - root_len - 1, ctx));
+	return (scandir_sub(fd, rpath, len, ctx));
 }
 
 #ifdef HAVE_DEVINFO_H
@@ -286,13 +478,14 @@ struct devname_scan_args {
 };
 
 static int
-devname_cb(const char *path, mode_t type, void *args)
+devname_cb(int dirfd, const char *name, const char *path, mode_t type,
+    void *args)
 {
 	struct devname_scan_args *sa = args;
 	struct stat st;
 
 	if (sa->type == type &&
-	    lstat(path, &st) == 0 &&
+	    fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
 	    st.ST_RDEV == sa->dev) {
 		strlcpy(sa->buf, path + 5, sa->len);
 		return (-1);
@@ -303,7 +496,6 @@ devname_cb(const char *path, mode_t type, void *args)
 char *
 devname_r(dev_t dev, mode_t type, char *buf, int len)
 {
-	char path[PATH_MAX] = "/dev/";
 	struct devname_scan_args args = {
 		.dev = dev,
 		.type = type,
@@ -320,7 +512,7 @@ devname_r(dev_t dev, mode_t type, char *buf, int len)
 		strlcpy(buf, "#NODEV", len);
 		return (buf);
 	}
-	if (scandir_recursive(path, sizeof(path), &ctx) == 0)
+	if (scandir_recursive("/dev/", &ctx) == 0)
 		/* Finally just format it */
 		snprintf(buf, len, "#%c:%#jx",
 		    S_ISCHR(type) ? 'C' : 'B', (uintmax_t)dev);
@@ -28,6 +28,7 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -92,7 +93,12 @@ do {									\
 #define	ST_RDEV	st_rdev
 #endif
 
-typedef int (* scandir_cb_t)(const char *path, mode_t type, void *args);
+/*
+ * Callback gets descriptor of the directory being read, entry name
+ * relative to it and full path of the entry.
+ */
+typedef int (* scandir_cb_t)(int dirfd, const char *name, const char *path,
+    mode_t type, void *args);
 
 /* If .recursive is true, then .cb gets called for non-dir
  * paths, an the overall scandir is recursive. If .recursive
@@ -103,13 +109,56 @@ struct scandir_ctx {
 	bool recursive;
 	scandir_cb_t cb;
 	void *args;
+	const char *fspath;	/* opened instead of the walked path if set */
+};
+
+/*
+ * Simple bump allocator. Memory is handed out from the initial buffer
+ * given to arena_init() and then from heap chunks chained on overflow.
+ * Nothing is freed individually, arena_free() releases everything.
+ */
+struct arena_chunk;
+struct arena {
+	char *ptr;
+	char *end;
+	struct arena_chunk *chunks;
 };
 
+#define	ARENA_CHUNK_SIZE	1024
+
+void arena_init(struct arena *a, void *buf, size_t size);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_vasprintf(struct arena *a, const char *fmt, va_list ap);
+void arena_free(struct arena *a);
+
+/*
+ * fnmatch(3) pattern (flags 0) classified at compile time so the common
+ * shapes are matched with plain string comparisons. Pattern string is
+ * referenced, not copied.
+ */
+enum {
+	FNPATTERN_LITERAL,	/* "abc" */
+	FNPATTERN_PREFIX,	/* "abc*" */
+	FNPATTERN_SUFFIX,	/* "*abc" */
+	FNPATTERN_UNIT,		/* "abc[0-9]*" in C locale */
+	FNPATTERN_GLOB,		/* anything else */
+};
+
+struct fnpattern {
+	int type;
+	size_t len;		/* length of literal part */
+	const char *literal;
+	const char *pattern;
+};
+
+void fnpattern_compile(struct fnpattern *fnp, const char *pattern);
+bool fnpattern_match(const struct fnpattern *fnp, const char *string);
+
 char *strbase(const char *path);
 char *get_kern_prop_value(const char *buf, const char *prop, size_t *len);
 int match_kern_prop_value(const char *buf, const char *prop, const char *value);
 int path_to_fd(const char *path);
-int scandir_recursive(char *path, size_t len, struct scandir_ctx *ctx);
+int scandir_recursive(const char *path, struct scandir_ctx *ctx);
 #ifdef HAVE_DEVINFO_H
 struct devinfo_dev;
 typedef int (* scandev_cb_t)(struct devinfo_dev *dev, void *args);